@@ -0,0 +1,202 @@
+#ifndef AGENTS_H
+#define AGENTS_H
+
+// The agent runtime.
+// Each agent declares which fields of the state it reads and writes and
+// provides a step function that reads generation n and writes its own
+// fields of generation n+1. The runtime sizes the thread team, packs the
+// agents onto the threads, and drives the step loop with one barrier per step.
+// ValidateAgents() checks the declarations before a run: a field that some
+// agent reads but no agent writes would keep its starting value for ever,
+// which is almost always an agent that was left out or mis-declared.
+//
+// Include this after struct State, the FIELD_* bits, Generations[], Finished(),
+// CopyFields(), barrier.h and rng.h, the same way UsCities.data is included after struct city.
+
+#include <stdio.h>
+
+// most agents that can be registered:
+#define MAX_AGENTS 64
+
+struct Agent {
+    const char* Name;
+    unsigned int Reads; // fields of generation n the step looks at
+    unsigned int Writes; // fields of generation n+1 the step sets
+    float Cost; // relative work per step, used to balance the threads
+    void (*Step)(const State& now, State& next, RngStream stream);
+    int Thread; // which thread of the team runs it (set by ScheduleAgents)
+    RngStream Stream; // the agent's own random numbers, named after it (set by RunAgents)
+};
+
+Agent Agents[MAX_AGENTS];
+int NumAgents = 0;
+
+// fields no agent writes -- the runtime carries them into the next generation:
+unsigned int CarriedFields = FIELD_ALL;
+
+// called by thread 0 at the start of every step after the first (including the
+// one that ends the run) with the generation before and the one just completed:
+void (*AgentObserver)(const State& previous, const State& now) = NULL;
+
+// returns false if the agent does not fit, names a field that does not exist, or writes
+// a field another agent already writes
+bool RegisterAgent(const char* name, unsigned int reads, unsigned int writes, float cost,
+    void (*step)(const State&, State&, RngStream))
+{
+    if (NumAgents >= MAX_AGENTS) {
+        fprintf(stderr, "Cannot register agent %s: only %d agents are allowed\n", name, MAX_AGENTS);
+        return false;
+    }
+
+    if (((reads | writes) & ~FIELD_ALL) != 0) {
+        fprintf(stderr, "Cannot register agent %s: it names a field that does not exist\n", name);
+        return false;
+    }
+
+    for (int a = 0; a < NumAgents; a++) {
+        if ((Agents[a].Writes & writes) != 0) {
+            fprintf(stderr, "Cannot register agent %s: it writes a field that %s already writes\n", name, Agents[a].Name);
+            return false;
+        }
+    }
+
+    Agent* agent = &Agents[NumAgents++];
+    agent->Name = name;
+    agent->Reads = reads;
+    agent->Writes = writes;
+    agent->Cost = cost;
+    agent->Step = step;
+    agent->Thread = 0;
+    CarriedFields &= ~agent->Writes;
+    return true;
+}
+
+// returns false (after naming them) if some agent reads a field no agent writes;
+// such a field is only carried forward, so it never changes
+bool ValidateAgents()
+{
+    unsigned int written = FIELD_ALL & ~CarriedFields;
+    bool ok = true;
+    for (int a = 0; a < NumAgents; a++) {
+        unsigned int unwritten = Agents[a].Reads & ~written;
+        for (int f = 0; f < (int)(sizeof(FieldNames) / sizeof(FieldNames[0])); f++) {
+            if (unwritten & (1 << f)) {
+                fprintf(stderr, "Agent %s reads %s, which no agent writes\n", Agents[a].Name, FieldNames[f]);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+// largest-cost-first onto the least loaded thread, so several light agents
+// share a thread when there are fewer threads than agents:
+void ScheduleAgents(int numThreads)
+{
+    float load[MAX_AGENTS] = {};
+    bool placed[MAX_AGENTS] = {};
+
+    for (int n = 0; n < NumAgents; n++) {
+        int heaviest = -1;
+        for (int a = 0; a < NumAgents; a++) {
+            if (!placed[a] && (heaviest < 0 || Agents[a].Cost > Agents[heaviest].Cost))
+                heaviest = a;
+        }
+
+        int lightest = 0;
+        for (int t = 1; t < numThreads; t++) {
+            if (load[t] < load[lightest])
+                lightest = t;
+        }
+
+        Agents[heaviest].Thread = lightest;
+        load[lightest] += Agents[heaviest].Cost;
+        placed[heaviest] = true;
+    }
+}
+
+// how many threads the runtime will use if the caller allows up to maxThreads:
+// never more than one per agent or one per processor
+int AgentThreads(int maxThreads)
+{
+    int numThreads = NumAgents;
+    if (numThreads > omp_get_num_procs())
+        numThreads = omp_get_num_procs();
+    if (maxThreads > 0 && numThreads > maxThreads)
+        numThreads = maxThreads;
+    if (numThreads < 1)
+        numThreads = 1;
+    if (numThreads > MAX_AGENTS)
+        numThreads = MAX_AGENTS;
+    return numThreads;
+}
+
+// run the registered agents from the given state, returns the final state
+State RunAgents(const State& start, int maxThreads)
+{
+    Generations[0] = start;
+    Generations[1] = start;
+
+#pragma omp parallel num_threads(AgentThreads(maxThreads))
+    {
+        // schedule for the team we actually got:
+#pragma omp single
+        {
+            ScheduleAgents(omp_get_num_threads());
+            for (int a = 0; a < NumAgents; a++) {
+                Agents[a].Stream = MakeStream(seed, 0, Agents[a].Name);
+                TraceName(Agents[a].Thread, Agents[a].Name);
+            }
+            InitBarrier(omp_get_num_threads());
+        } // implied barrier
+
+        int me = omp_get_thread_num();
+        State previous = start;
+        for (int step = 0;; step++) {
+            const State& now = Generations[step % 2];
+            State& next = Generations[(step + 1) % 2];
+
+            if (me == 0) {
+                if (step > 0 && AgentObserver != NULL)
+                    AgentObserver(previous, now);
+                previous = now;
+            }
+
+            if (Finished(now))
+                break;
+
+            if (me == 0)
+                CopyFields(now, next, CarriedFields);
+
+            for (int a = 0; a < NumAgents; a++) {
+                if (Agents[a].Thread == me)
+                    Agents[a].Step(now, next, Agents[a].Stream);
+            }
+
+            // DoneStepping barrier:
+            WaitBarrier("DoneStepping");
+        }
+    }
+
+    return Finished(Generations[0]) ? Generations[0] : Generations[1];
+}
+
+// print the agents, the fields they use, and the thread each one was put on
+void PrintAgents(FILE* fp)
+{
+    for (int a = 0; a < NumAgents; a++) {
+        fprintf(fp, "%-10s thread %2d  cost %5.2f  reads", Agents[a].Name, Agents[a].Thread, Agents[a].Cost);
+        for (int f = 0; f < (int)(sizeof(FieldNames) / sizeof(FieldNames[0])); f++) {
+            if (Agents[a].Reads & (1 << f))
+                fprintf(fp, " %s", FieldNames[f]);
+        }
+        fprintf(fp, "  writes");
+        for (int f = 0; f < (int)(sizeof(FieldNames) / sizeof(FieldNames[0])); f++) {
+            if (Agents[a].Writes & (1 << f))
+                fprintf(fp, " %s", FieldNames[f]);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+#endif // AGENTS_H
@@ -0,0 +1,223 @@
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <atomic>
+#include <chrono>
+#include <limits.h>
+#include <linux/futex.h>
+#include <omp.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_RELAX() _mm_pause()
+#else
+#define CPU_RELAX() ((void)0)
+#endif
+
+// how many times the futex barrier polls before going to sleep in the kernel:
+#ifndef FUTEX_SPIN_LIMIT
+#define FUTEX_SPIN_LIMIT 4096
+#endif
+
+// most threads the barrier statistics keep a slot for:
+#define MAX_BARRIER_THREADS 64
+
+// the barrier implementations that can be picked at runtime with --barrier=
+enum BarrierType {
+    BARRIER_LOCK, // the original omp_lock + volatile counter barrier
+    BARRIER_SPIN, // std::atomic sense-reversing spin barrier
+    BARRIER_FUTEX, // sense-reversing, spin for a while and then sleep on a futex
+    BARRIER_PTHREAD // pthread_barrier_wait()
+};
+
+const char* BarrierNames[] = { "lock", "spin", "futex", "pthread" };
+
+// per-thread wait statistics, padded so the threads do not false-share:
+struct alignas(64) BarrierStats {
+    long long calls;
+    double waitSeconds;
+    double maxWaitSeconds;
+};
+
+BarrierType BarrierKind = BARRIER_LOCK;
+BarrierStats BarrierStatsPerThread[MAX_BARRIER_THREADS];
+
+// Global variables for the lock barrier
+omp_lock_t Lock;
+volatile int NumInThreadTeam;
+volatile int NumAtBarrier;
+volatile int NumGone;
+
+// Global variables for the sense-reversing barriers
+// (the count and the sense live on separate cache lines so that
+// arriving threads do not invalidate the line the waiters are polling)
+alignas(64) std::atomic<int> SenseCount;
+alignas(64) std::atomic<int> Sense;
+alignas(64) std::atomic<int> NumSleeping;
+
+// Global variables for the pthread barrier
+pthread_barrier_t PthreadBarrier;
+bool PthreadBarrierInitialized = false;
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int), "the futex word must be a plain int");
+
+// returns false if the name is not one of BarrierNames[]
+bool ParseBarrierType(const char* name, BarrierType* kind)
+{
+    for (int b = 0; b < (int)(sizeof(BarrierNames) / sizeof(BarrierNames[0])); b++) {
+        if (strcmp(name, BarrierNames[b]) == 0) {
+            *kind = (BarrierType)b;
+            return true;
+        }
+    }
+    return false;
+}
+
+void InitBarrier(int n)
+{
+    NumInThreadTeam = n;
+    NumAtBarrier = 0;
+    omp_init_lock(&Lock);
+
+    SenseCount.store(n);
+    Sense.store(0);
+    NumSleeping.store(0);
+
+    if (PthreadBarrierInitialized)
+        pthread_barrier_destroy(&PthreadBarrier);
+    pthread_barrier_init(&PthreadBarrier, NULL, n);
+    PthreadBarrierInitialized = true;
+
+    memset(BarrierStatsPerThread, 0, sizeof(BarrierStatsPerThread));
+}
+
+void LockWaitBarrier()
+{
+    omp_set_lock(&Lock);
+    {
+        NumAtBarrier++;
+        if (NumAtBarrier == NumInThreadTeam) {
+            NumGone = 0;
+            NumAtBarrier = 0;
+            // let all other threads get back to what they were doing
+            // before this one unlocks, knowing that they might immediately
+            // call WaitBarrier() again:
+            while (NumGone != NumInThreadTeam - 1)
+                ;
+            omp_unset_lock(&Lock);
+            return;
+        }
+    }
+    omp_unset_lock(&Lock);
+
+    while (NumAtBarrier != 0)
+        ; // this waits for the nth thread to arrive
+
+#pragma omp atomic
+    NumGone++; // this flags how many threads have returned
+}
+
+// the sense cannot flip until this thread has arrived, so the value we
+// are going to wait for is just the opposite of what it is right now.
+// the last thread to arrive re-arms the count and then flips the sense,
+// the release store publishing everything written before the barrier:
+void SpinWaitBarrier()
+{
+    int mySense = 1 - Sense.load(std::memory_order_relaxed);
+    if (SenseCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        SenseCount.store(NumInThreadTeam, std::memory_order_relaxed);
+        Sense.store(mySense, std::memory_order_release);
+        return;
+    }
+
+    while (Sense.load(std::memory_order_acquire) != mySense)
+        CPU_RELAX();
+}
+
+long Futex(std::atomic<int>* word, int op, int value)
+{
+    return syscall(SYS_futex, reinterpret_cast<int*>(word), op, value, NULL, NULL, 0);
+}
+
+// same as SpinWaitBarrier(), but after FUTEX_SPIN_LIMIT polls the waiter
+// goes to sleep on the sense word instead of burning its core.
+// the waiter announces itself in NumSleeping before it re-checks the sense
+// and the releaser flips the sense before it looks at NumSleeping, so one
+// of them always sees the other (the kernel re-checks the word atomically):
+void FutexWaitBarrier()
+{
+    int oldSense = Sense.load(std::memory_order_relaxed);
+    int mySense = 1 - oldSense;
+    if (SenseCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        SenseCount.store(NumInThreadTeam, std::memory_order_relaxed);
+        Sense.store(mySense, std::memory_order_seq_cst);
+        if (NumSleeping.load(std::memory_order_seq_cst) > 0)
+            Futex(&Sense, FUTEX_WAKE_PRIVATE, INT_MAX);
+        return;
+    }
+
+    for (int spin = 0; spin < FUTEX_SPIN_LIMIT; spin++) {
+        if (Sense.load(std::memory_order_acquire) == mySense)
+            return;
+        CPU_RELAX();
+    }
+
+    NumSleeping.fetch_add(1, std::memory_order_seq_cst);
+    while (Sense.load(std::memory_order_seq_cst) != mySense)
+        Futex(&Sense, FUTEX_WAIT_PRIVATE, oldSense); // returns at once if the sense already flipped
+    NumSleeping.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// phase names which barrier this is, for the trace
+void WaitBarrier(const char* phase = "Barrier")
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    switch (BarrierKind) {
+    case BARRIER_LOCK:
+        LockWaitBarrier();
+        break;
+    case BARRIER_SPIN:
+        SpinWaitBarrier();
+        break;
+    case BARRIER_FUTEX:
+        FutexWaitBarrier();
+        break;
+    case BARRIER_PTHREAD:
+        pthread_barrier_wait(&PthreadBarrier);
+        break;
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+    double wait = std::chrono::duration<double>(t1 - t0).count();
+    int me = omp_get_thread_num();
+    if (Tracing)
+        TraceBarrier(me, phase, t0, t1);
+
+    BarrierStats* s = &BarrierStatsPerThread[me % MAX_BARRIER_THREADS];
+    s->calls++;
+    s->waitSeconds += wait;
+    if (wait > s->maxWaitSeconds)
+        s->maxWaitSeconds = wait;
+}
+
+// combine the per-thread statistics after the team has joined:
+BarrierStats SumBarrierStats()
+{
+    BarrierStats total = {};
+    for (int t = 0; t < MAX_BARRIER_THREADS; t++) {
+        total.calls += BarrierStatsPerThread[t].calls;
+        total.waitSeconds += BarrierStatsPerThread[t].waitSeconds;
+        if (BarrierStatsPerThread[t].maxWaitSeconds > total.maxWaitSeconds)
+            total.maxWaitSeconds = BarrierStatsPerThread[t].maxWaitSeconds;
+    }
+    return total;
+}
+
+#endif // BARRIER_H
@@ -1,11 +1,62 @@
 #!/bin/bash
 
 # Compile with OpenMP support
-g++ -fopenmp -o main main.cpp -lm
+# (C++20 for --mode=coroutines; the original lock barrier spins on volatile
+# counters, whose ++ C++20 deprecates)
+g++ -std=c++20 -Wno-volatile -fopenmp -o main main.cpp -lm
+
+# The SIMD ensemble engine, one member per lane: 8 lanes with AVX2, 16 with AVX-512
+# (optimized, since the vector wrappers are only worth it once they are inlined)
+g++ -fopenmp -O3 -DUSE_AVX -mavx2 -mfma -o main_avx2 main.cpp -lm
+g++ -fopenmp -O3 -DUSE_AVX512 -mavx512f -o main_avx512 main.cpp -lm
 
 # Run the simulation
 ./main > simulation_data.csv
 
+# Compare the engines and barrier implementations over the same run
+# (the timing line for each run is written to stderr)
+echo "Mode,Barrier,Threads,Members,Months,WallSeconds,CpuSeconds,MemberMonthsPerSecond,SimulationsPerSecond,BarrierCalls,MeanWaitMicroseconds,MaxWaitMicroseconds,WriterStalls" > timing_results.csv
+for mode in sections double agents
+do
+    for barrier in lock spin futex pthread
+    do
+        ./main --mode=$mode --barrier=$barrier > /dev/null 2>> timing_results.csv
+    done
+done
+
+# A timeline of who waits for whom at each barrier, for chrome://tracing or Perfetto
+./main --mode=sections --barrier=futex --trace=barrier_trace.json > /dev/null 2> /dev/null
+
+# The same agents as coroutines on one thread, with no threads to synchronize
+./main --mode=coroutines > /dev/null 2>> timing_results.csv
+
+# Long horizons, 10^3 to 10^8 months: steps/sec for the coroutine engine with a row
+# of means per century, for the threaded engine while it is still affordable, and
+# for a run that is fast-forwarded all the way through
+for months in 1000 10000 100000 1000000 10000000 100000000
+do
+    ./main --mode=coroutines --months=$months --every=1200 > /dev/null 2>> timing_results.csv
+    if [ $months -le 1000000 ]
+    then
+        ./main --mode=double --barrier=futex --months=$months --every=1200 > /dev/null 2>> timing_results.csv
+    fi
+    ./main --months=$months --warmup=$months > /dev/null 2>> timing_results.csv
+done
+
+# Statistics over many seeds: the ensemble runner at growing sizes
+for members in 1000 10000 100000 1000000
+do
+    ./main --mode=ensemble --members=$members > ensemble_$members.csv 2>> timing_results.csv
+    ./main_avx2 --mode=simd --members=$members > /dev/null 2>> timing_results.csv
+    ./main_avx512 --mode=simd --members=$members > /dev/null 2>> timing_results.csv
+done
+
+# The landscape version: cell-updates/sec on a 2048 x 2048 grid as the threads are added
+for t in 1 2 4 6 8
+do
+    ./main --mode=grid --threads=$t > grid_data.csv 2>> timing_results.csv
+done
+
 # Convert data to metric units for better visualization
 awk -F, 'BEGIN {OFS=","; print "Month,Year,Temp(C),Precip(cm),Height(cm),Deer,WeedDensity"}
          NR>1 {
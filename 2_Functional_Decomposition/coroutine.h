@@ -0,0 +1,198 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+// The coroutine engine.
+// Deer, Grain, Weeds and the Watcher run exactly as in --mode=sections,
+// reading and writing Now with DoneComputing, DoneAssigning and DonePrinting
+// barriers, but as C++20 coroutines on one thread. Waiting at a barrier is a
+// co_await that suspends the agent; the last agent to arrive queues the
+// others and carries on, and a small run queue resumes them one after another.
+// A barrier costs a few function calls instead of cache-line traffic between
+// cores, which wins whenever an agent's work per month is tiny.
+//
+// Needs a C++20 compiler (-std=c++20); without one HAVE_COROUTINES is not
+// defined and --mode=coroutines is refused.
+//
+// Include this after the Compute*() functions and RecordRow().
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#define HAVE_COROUTINES 1
+
+#include <coroutine>
+#include <exception>
+
+// most coroutines the scheduler can hold:
+#define MAX_COROUTINES 64
+
+// the handle of an agent coroutine; it starts suspended until the scheduler resumes it
+struct CoAgent {
+    struct promise_type {
+        CoAgent get_return_object() { return CoAgent { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> Handle;
+};
+
+// the run queue: coroutines ready to be resumed, in order
+// (a ring -- every coroutine is in it at most once)
+std::coroutine_handle<> CoReady[MAX_COROUTINES];
+int CoReadyHead = 0;
+int CoReadyCount = 0;
+long long CoBarrierCalls = 0;
+
+void CoMakeReady(std::coroutine_handle<> h)
+{
+    CoReady[(CoReadyHead + CoReadyCount) % MAX_COROUTINES] = h;
+    CoReadyCount++;
+}
+
+// a barrier for coroutines on one thread: co_await Barrier.Wait()
+struct CoBarrier {
+    int NumAgents;
+    int NumArrived;
+    std::coroutine_handle<> Waiting[MAX_COROUTINES];
+
+    struct Awaiter {
+        CoBarrier* Barrier;
+
+        bool await_ready() const noexcept { return false; }
+
+        // returns false (carry on without suspending) for the last agent to arrive
+        bool await_suspend(std::coroutine_handle<> h) noexcept
+        {
+            CoBarrier* b = Barrier;
+            CoBarrierCalls++;
+            if (b->NumArrived + 1 < b->NumAgents) {
+                b->Waiting[b->NumArrived++] = h;
+                return true;
+            }
+
+            for (int i = 0; i < b->NumArrived; i++)
+                CoMakeReady(b->Waiting[i]);
+            b->NumArrived = 0;
+            return false;
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+    Awaiter Wait() { return Awaiter { this }; }
+};
+
+CoBarrier CoPhase;
+
+// Deer coroutine
+CoAgent CoDeer()
+{
+    while (!Finished(Now)) {
+        int nextNumDeer = ComputeNumDeer(Now);
+
+        // DoneComputing barrier:
+        co_await CoPhase.Wait();
+
+        Now.NumDeer = nextNumDeer;
+
+        // DoneAssigning barrier:
+        co_await CoPhase.Wait();
+
+        // DonePrinting barrier:
+        co_await CoPhase.Wait();
+    }
+}
+
+// Grain coroutine
+CoAgent CoGrain()
+{
+    while (!Finished(Now)) {
+        float nextHeight = ComputeHeight(Now);
+
+        // DoneComputing barrier:
+        co_await CoPhase.Wait();
+
+        Now.Height = nextHeight;
+
+        // DoneAssigning barrier:
+        co_await CoPhase.Wait();
+
+        // DonePrinting barrier:
+        co_await CoPhase.Wait();
+    }
+}
+
+// Watcher coroutine
+CoAgent CoWatcher()
+{
+    while (!Finished(Now)) {
+        State next = Now;
+        AdvanceWeather(Now, next, WeatherStream);
+
+        // DoneComputing barrier:
+        co_await CoPhase.Wait();
+
+        // DoneAssigning barrier:
+        co_await CoPhase.Wait();
+
+        RecordRow(Now, Now);
+        CopyFields(next, Now, FIELD_YEAR | FIELD_MONTH | FIELD_TEMP | FIELD_PRECIP);
+
+        // DonePrinting barrier:
+        co_await CoPhase.Wait();
+    }
+}
+
+// Weeds coroutine
+CoAgent CoWeeds()
+{
+    while (!Finished(Now)) {
+        float nextWeedDensity = ComputeWeedDensity(Now);
+
+        // DoneComputing barrier:
+        co_await CoPhase.Wait();
+
+        Now.WeedDensity = nextWeedDensity;
+
+        // DoneAssigning barrier:
+        co_await CoPhase.Wait();
+
+        // DonePrinting barrier:
+        co_await CoPhase.Wait();
+    }
+}
+
+// run the simulation from the given state on this thread, returns the final state
+State RunCoroutines(const State& start)
+{
+    Now = start;
+
+    CoAgent agents[] = { CoDeer(), CoGrain(), CoWatcher(), CoWeeds() };
+    int numAgents = (int)(sizeof(agents) / sizeof(agents[0]));
+
+    CoPhase.NumAgents = numAgents;
+    CoPhase.NumArrived = 0;
+    CoReadyHead = 0;
+    CoReadyCount = 0;
+    CoBarrierCalls = 0;
+    for (int a = 0; a < numAgents; a++)
+        CoMakeReady(agents[a].Handle);
+
+    while (CoReadyCount > 0) {
+        std::coroutine_handle<> h = CoReady[CoReadyHead];
+        CoReadyHead = (CoReadyHead + 1) % MAX_COROUTINES;
+        CoReadyCount--;
+        h.resume();
+    }
+
+    for (int a = 0; a < numAgents; a++)
+        agents[a].Handle.destroy();
+
+    return Now;
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // COROUTINE_H
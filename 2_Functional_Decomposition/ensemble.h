@@ -0,0 +1,185 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+// The ensemble runner.
+// Runs many independent simulations as parallel tasks, one simulation per
+// task, each one stepping Deer, Grain, Weeds and the weather serially with
+// no barriers and with its own weather stream (member 0 draws the same weather
+// as a single run). Every member records its state each month so that the mean
+// and the percentiles of every state variable can be reported per month.
+//
+// Include this after the Compute*() functions and writer.h.
+
+#include <algorithm>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// the state variables recorded for each member each month:
+enum EnsembleVariable {
+    VAR_TEMP,
+    VAR_PRECIP,
+    VAR_HEIGHT,
+    VAR_NUMDEER,
+    VAR_WEEDDENSITY,
+    NUMVARS
+};
+
+const char* EnsembleVariableNames[] = { "Temp", "Precip", "Height", "Deer", "WeedDensity" };
+
+// the percentiles reported for each variable each month:
+const float EnsemblePercentiles[] = { 5., 25., 50., 75., 95. };
+#define NUMPERCENTILES (int)(sizeof(EnsemblePercentiles) / sizeof(EnsemblePercentiles[0]))
+
+// how many members a thread takes at a time:
+#ifndef ENSEMBLE_CHUNK
+#define ENSEMBLE_CHUNK 16
+#endif
+
+int EnsembleMembers = 0;
+int EnsembleMonths = 0;
+int EnsembleThreads = 0;
+bool EnsembleStream = false; // also hand every member's every month to the writer
+
+// EnsembleValues[(month * NUMVARS + variable) * EnsembleMembers + member]
+// (each month's variable is contiguous, ready for the percentile search)
+float* EnsembleValues = NULL;
+
+// one simulation from start to EndMonth, recorded into EnsembleValues
+void RunMember(const State& start, int member)
+{
+    RngStream weather = MakeStream(seed, member, "Weather");
+
+    State now = start;
+    ComputeWeather(now, weather);
+
+    for (int month = 0; month < EnsembleMonths; month++) {
+        State next;
+        next.NumDeer = ComputeNumDeer(now);
+        next.Height = ComputeHeight(now);
+        next.WeedDensity = ComputeWeedDensity(now);
+
+        // the same row the Watcher prints: this month's weather, next month's populations
+        float* values = &EnsembleValues[(size_t)month * NUMVARS * EnsembleMembers + member];
+        values[(size_t)VAR_TEMP * EnsembleMembers] = now.Temp;
+        values[(size_t)VAR_PRECIP * EnsembleMembers] = now.Precip;
+        values[(size_t)VAR_HEIGHT * EnsembleMembers] = next.Height;
+        values[(size_t)VAR_NUMDEER * EnsembleMembers] = (float)next.NumDeer;
+        values[(size_t)VAR_WEEDDENSITY * EnsembleMembers] = next.WeedDensity;
+
+        if (EnsembleStream) {
+            OutputRecord record = { member, now.Month + 1, now.Year, now.Temp, now.Precip,
+                next.Height, next.NumDeer, next.WeedDensity };
+            WriterPush(omp_get_thread_num(), record);
+        }
+
+        AdvanceWeather(now, next, weather);
+        now = next;
+    }
+}
+
+// returns false (after saying why) if every member's every month would not fit:
+// the months are counted in ints, and the values must fit in the machine's memory
+bool EnsembleFits(const State& start, int members)
+{
+    long long months = EndMonth - MonthIndex(start);
+    if (months > INT_MAX / NUMVARS) {
+        fprintf(stderr, "An ensemble can run at most %d months\n", INT_MAX / NUMVARS);
+        return false;
+    }
+
+    size_t perMonth = (size_t)NUMVARS * (size_t)members * sizeof(float);
+    size_t memory = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+    if (months > 0 && (size_t)months > memory / perMonth) {
+        fprintf(stderr, "%lld months of %d members need %.1lf GB, more than the %.1lf GB of memory\n",
+            months, members, (double)months * (double)perMonth / 1.e9, (double)memory / 1.e9);
+        return false;
+    }
+    return true;
+}
+
+// room for every member's every month (see EnsembleFits())
+void AllocateEnsemble(const State& start, int members)
+{
+    EnsembleMembers = members;
+    EnsembleMonths = (int)(EndMonth - MonthIndex(start));
+
+    delete[] EnsembleValues;
+    EnsembleValues = new float[(size_t)EnsembleMonths * NUMVARS * EnsembleMembers];
+}
+
+// run the members from the given state, returns the date they all end on
+State RunEnsemble(const State& start, int members, int maxThreads)
+{
+    AllocateEnsemble(start, members);
+
+    if (maxThreads > 0)
+        omp_set_num_threads(maxThreads);
+    else
+        omp_set_num_threads(omp_get_num_procs());
+
+#pragma omp parallel
+    {
+#pragma omp single nowait
+        EnsembleThreads = omp_get_num_threads();
+
+#pragma omp for schedule(dynamic, ENSEMBLE_CHUNK)
+        for (int member = 0; member < members; member++) {
+            RunMember(start, member);
+        }
+    }
+
+    State end = start;
+    end.Year = (int)(EndMonth / 12);
+    end.Month = (int)(EndMonth % 12);
+    return end;
+}
+
+// print the mean and the percentiles of every variable for every month:
+// Month,Year,Variable,Mean,P05,P25,P50,P75,P95
+void PrintEnsemble(const State& start, FILE* fp)
+{
+    int numColumns = EnsembleMonths * NUMVARS;
+    float* stats = new float[(size_t)numColumns * (1 + NUMPERCENTILES)];
+
+    // nth_element() reorders each column, which is fine, it is not needed afterwards:
+#pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < numColumns; c++) {
+        float* column = &EnsembleValues[(size_t)c * EnsembleMembers];
+        float* out = &stats[(size_t)c * (1 + NUMPERCENTILES)];
+
+        double sum = 0.;
+        for (int member = 0; member < EnsembleMembers; member++)
+            sum += column[member];
+        out[0] = (float)(sum / (double)EnsembleMembers);
+
+        for (int p = 0; p < NUMPERCENTILES; p++) {
+            int rank = (int)(EnsemblePercentiles[p] / 100. * (double)(EnsembleMembers - 1) + 0.5);
+            std::nth_element(column, column + rank, column + EnsembleMembers);
+            out[1 + p] = column[rank];
+        }
+    }
+
+    fprintf(fp, "Month,Year,Variable,Mean");
+    for (int p = 0; p < NUMPERCENTILES; p++)
+        fprintf(fp, ",P%02d", (int)EnsemblePercentiles[p]);
+    fprintf(fp, "\n");
+
+    State date = start;
+    for (int month = 0; month < EnsembleMonths; month++) {
+        for (int v = 0; v < NUMVARS; v++) {
+            float* out = &stats[((size_t)month * NUMVARS + v) * (1 + NUMPERCENTILES)];
+            fprintf(fp, "%d,%d,%s,%.2f", date.Month + 1, date.Year, EnsembleVariableNames[v], out[0]);
+            for (int p = 0; p < NUMPERCENTILES; p++)
+                fprintf(fp, ",%.2f", out[1 + p]);
+            fprintf(fp, "\n");
+        }
+        AdvanceMonth(date, date);
+    }
+
+    delete[] stats;
+}
+
+#endif // ENSEMBLE_H
@@ -0,0 +1,236 @@
+#ifndef GRID_H
+#define GRID_H
+
+// The landscape engine.
+// Runs the model over a 2D grid of cells instead of a single point. Every
+// cell has its own grain, deer and weeds and is advanced with the same
+// ComputeNumDeer(), ComputeHeight() and ComputeWeedDensity() as the single
+// point; the weather is the same everywhere. Between cells:
+//  - deer a cell's grain cannot carry leave it, a quarter of the excess to
+//    each of its four neighbours
+//  - weeds spread: each cell's density moves WEED_SPREAD_RATE of the way
+//    toward the mean of its four neighbours
+//
+// The grid is double-buffered and surrounded by a one-cell halo that mirrors
+// the edge cells, so the edge sends as many deer into the halo as it gets
+// back and nothing is lost over the border. The cells are updated tile by
+// tile (GRID_TILE_X x GRID_TILE_Y, so the three rows a tile's stencil touches
+// stay in cache) with the tiles spread over the threads, and each tile on the
+// border also writes its part of the next halo.
+//
+// Include this after the Compute*() functions.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// the tile size, in cells:
+#ifndef GRID_TILE_X
+#define GRID_TILE_X 256
+#endif
+
+#ifndef GRID_TILE_Y
+#define GRID_TILE_Y 16
+#endif
+
+const float WEED_SPREAD_RATE = 0.2; // fraction of the way toward the neighbours' density per month
+
+int GridWidth = 2048;
+int GridHeight = 2048;
+int GridPitch; // GridWidth + 2 for the halo
+int GridThreads = 0;
+
+// [generation][(y+1) * GridPitch + (x+1)] -- row and column 0 and the last ones are the halo
+float* GridGrainHeight[2];
+int* GridNumDeer[2];
+float* GridWeedDensity[2];
+
+// deer a cell sends to each neighbour this month
+inline int DeerShare(int numDeer, float height)
+{
+    int excess = numDeer - (int)(height);
+    return (excess > 0) ? excess / 4 : 0;
+}
+
+// copy the edge cells of generation g into its halo (only for the starting state,
+// after that the tiles on the border keep the halo up to date)
+void FillHalo(int g)
+{
+    for (int y = 1; y <= GridHeight; y++) {
+        size_t row = (size_t)y * GridPitch;
+        GridGrainHeight[g][row] = GridGrainHeight[g][row + 1];
+        GridNumDeer[g][row] = GridNumDeer[g][row + 1];
+        GridWeedDensity[g][row] = GridWeedDensity[g][row + 1];
+        GridGrainHeight[g][row + GridWidth + 1] = GridGrainHeight[g][row + GridWidth];
+        GridNumDeer[g][row + GridWidth + 1] = GridNumDeer[g][row + GridWidth];
+        GridWeedDensity[g][row + GridWidth + 1] = GridWeedDensity[g][row + GridWidth];
+    }
+
+    size_t last = (size_t)(GridHeight + 1) * GridPitch;
+    for (int x = 1; x <= GridWidth; x++) {
+        GridGrainHeight[g][x] = GridGrainHeight[g][GridPitch + x];
+        GridNumDeer[g][x] = GridNumDeer[g][GridPitch + x];
+        GridWeedDensity[g][x] = GridWeedDensity[g][GridPitch + x];
+        GridGrainHeight[g][last + x] = GridGrainHeight[g][last - GridPitch + x];
+        GridNumDeer[g][last + x] = GridNumDeer[g][last - GridPitch + x];
+        GridWeedDensity[g][last + x] = GridWeedDensity[g][last - GridPitch + x];
+    }
+}
+
+// the start state with every cell's grain, deer and weeds scattered around it
+void InitGrid(const State& start)
+{
+    GridPitch = GridWidth + 2;
+    size_t numCells = (size_t)GridPitch * (GridHeight + 2);
+    for (int g = 0; g < 2; g++) {
+        delete[] GridGrainHeight[g];
+        delete[] GridNumDeer[g];
+        delete[] GridWeedDensity[g];
+        GridGrainHeight[g] = new float[numCells];
+        GridNumDeer[g] = new int[numCells];
+        GridWeedDensity[g] = new float[numCells];
+    }
+
+    // every cell's starting state is its own number of the "Cells" stream:
+    RngStream cells = MakeStream(seed, 0, "Cells");
+
+    // first touch from the threads that will update the cells:
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < GridHeight + 2; y++) {
+        for (int x = 0; x < GridPitch; x++) {
+            size_t c = (size_t)y * GridPitch + x;
+            uint32_t h = RandomBits(cells, (uint32_t)c);
+            GridGrainHeight[0][c] = start.Height * (float)(h & 0xff) / 128.f; // 0 - 2x
+            GridNumDeer[0][c] = start.NumDeer * (int)((h >> 8) & 0x3) / 2; // 0 - 1.5x
+            GridWeedDensity[0][c] = start.WeedDensity * (float)((h >> 16) & 0xff) / 128.f; // 0 - 2x
+            GridGrainHeight[1][c] = 0.;
+            GridNumDeer[1][c] = 0;
+            GridWeedDensity[1][c] = 0.;
+        }
+    }
+
+    FillHalo(0);
+}
+
+// one month for every cell of generation g into generation 1-g;
+// puts the new generation's mean grain height and weed density and its
+// total number of deer into populations
+void StepGrid(const State& weather, int g, State& populations)
+{
+    const float* height = GridGrainHeight[g];
+    const int* numDeer = GridNumDeer[g];
+    const float* weedDensity = GridWeedDensity[g];
+    float* nextHeight = GridGrainHeight[1 - g];
+    int* nextNumDeer = GridNumDeer[1 - g];
+    float* nextWeedDensity = GridWeedDensity[1 - g];
+
+    int tilesX = (GridWidth + GRID_TILE_X - 1) / GRID_TILE_X;
+    int tilesY = (GridHeight + GRID_TILE_Y - 1) / GRID_TILE_Y;
+    double sumHeight = 0., sumNumDeer = 0., sumWeedDensity = 0.;
+
+#pragma omp parallel for collapse(2) schedule(static) reduction(+ : sumHeight, sumNumDeer, sumWeedDensity)
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            int y0 = 1 + ty * GRID_TILE_Y;
+            int y1 = y0 + GRID_TILE_Y < GridHeight + 1 ? y0 + GRID_TILE_Y : GridHeight + 1;
+            int x0 = 1 + tx * GRID_TILE_X;
+            int x1 = x0 + GRID_TILE_X < GridWidth + 1 ? x0 + GRID_TILE_X : GridWidth + 1;
+
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    size_t c = (size_t)y * GridPitch + x;
+                    size_t n = c - GridPitch, s = c + GridPitch, w = c - 1, e = c + 1;
+
+                    // this month's state of the cell, once the deer have moved and the weeds spread:
+                    State cell = weather;
+                    cell.Height = height[c];
+                    cell.NumDeer = numDeer[c] - 4 * DeerShare(numDeer[c], height[c])
+                        + DeerShare(numDeer[n], height[n]) + DeerShare(numDeer[s], height[s])
+                        + DeerShare(numDeer[w], height[w]) + DeerShare(numDeer[e], height[e]);
+                    float neighbourWeeds = 0.25f * (weedDensity[n] + weedDensity[s] + weedDensity[w] + weedDensity[e]);
+                    cell.WeedDensity = weedDensity[c] + WEED_SPREAD_RATE * (neighbourWeeds - weedDensity[c]);
+
+                    nextNumDeer[c] = ComputeNumDeer(cell);
+                    nextHeight[c] = ComputeHeight(cell);
+                    nextWeedDensity[c] = ComputeWeedDensity(cell);
+
+                    sumHeight += nextHeight[c];
+                    sumNumDeer += nextNumDeer[c];
+                    sumWeedDensity += nextWeedDensity[c];
+                }
+            }
+
+            // the halo next to this tile mirrors its edge cells:
+            if (x0 == 1) {
+                for (int y = y0; y < y1; y++) {
+                    size_t c = (size_t)y * GridPitch;
+                    nextHeight[c] = nextHeight[c + 1];
+                    nextNumDeer[c] = nextNumDeer[c + 1];
+                    nextWeedDensity[c] = nextWeedDensity[c + 1];
+                }
+            }
+            if (x1 == GridWidth + 1) {
+                for (int y = y0; y < y1; y++) {
+                    size_t c = (size_t)y * GridPitch + GridWidth + 1;
+                    nextHeight[c] = nextHeight[c - 1];
+                    nextNumDeer[c] = nextNumDeer[c - 1];
+                    nextWeedDensity[c] = nextWeedDensity[c - 1];
+                }
+            }
+            if (y0 == 1) {
+                for (int x = x0; x < x1; x++) {
+                    nextHeight[x] = nextHeight[GridPitch + x];
+                    nextNumDeer[x] = nextNumDeer[GridPitch + x];
+                    nextWeedDensity[x] = nextWeedDensity[GridPitch + x];
+                }
+            }
+            if (y1 == GridHeight + 1) {
+                size_t last = (size_t)(GridHeight + 1) * GridPitch;
+                for (int x = x0; x < x1; x++) {
+                    nextHeight[last + x] = nextHeight[last - GridPitch + x];
+                    nextNumDeer[last + x] = nextNumDeer[last - GridPitch + x];
+                    nextWeedDensity[last + x] = nextWeedDensity[last - GridPitch + x];
+                }
+            }
+        }
+    }
+
+    double numCells = (double)GridWidth * (double)GridHeight;
+    populations.Height = (float)(sumHeight / numCells);
+    populations.NumDeer = (int)sumNumDeer;
+    populations.WeedDensity = (float)(sumWeedDensity / numCells);
+}
+
+// run the landscape from the given state, returns the final state
+// (with the landscape's means and deer total as its populations)
+State RunGrid(const State& start, int maxThreads)
+{
+    if (maxThreads > 0)
+        omp_set_num_threads(maxThreads);
+    else
+        omp_set_num_threads(omp_get_num_procs());
+
+#pragma omp parallel
+    {
+#pragma omp single
+        GridThreads = omp_get_num_threads();
+    }
+
+    InitGrid(start);
+
+    State now = start;
+    int g = 0;
+    while (!Finished(now)) {
+        State next = now;
+        StepGrid(now, g, next);
+        RecordRow(now, next);
+        g = 1 - g;
+
+        // the weather is the same everywhere, so it is drawn once a month:
+        AdvanceWeather(now, next, WeatherStream);
+        now = next;
+    }
+
+    return now;
+}
+
+#endif // GRID_H
@@ -1,39 +1,90 @@
 #define _USE_MATH_DEFINES
-#include <iostream>
 #include <math.h>
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string>
-#include <vector>
+#include <string.h>
+#include <sys/resource.h>
 
-// Random number generator seed
+#include "barrier.h"
+#include "rng.h"
+#include "writer.h"
+
+// Random number generator seed (--seed=)
 unsigned int seed = 0;
 
+// The simulation state for one month
+struct State {
+    int Year; // 2025 onward
+    int Month; // 0 - 11
+    float Precip; // inches of rain per month
+    float Temp; // temperature this month
+    float Height; // grain height in inches
+    int NumDeer; // number of deer in the current population
+    float WeedDensity; // density of weeds (0 to 1)
+};
+
+// the fields of the state, as bits for Agent::Reads and Agent::Writes:
+enum StateField {
+    FIELD_YEAR = 1 << 0,
+    FIELD_MONTH = 1 << 1,
+    FIELD_PRECIP = 1 << 2,
+    FIELD_TEMP = 1 << 3,
+    FIELD_HEIGHT = 1 << 4,
+    FIELD_NUMDEER = 1 << 5,
+    FIELD_WEEDDENSITY = 1 << 6,
+    FIELD_ALL = (1 << 7) - 1
+};
+
+const char* FieldNames[] = { "Year", "Month", "Precip", "Temp", "Height", "NumDeer", "WeedDensity" };
+
+// the engines that can be picked at runtime with --mode=
+enum Mode {
+    MODE_SECTIONS, // every agent reads and writes Now, three barriers per month
+    MODE_DOUBLE, // agents read one generation and write the next, one barrier per month
+    MODE_AGENTS, // the registered agents packed onto as many threads as are useful
+    MODE_ENSEMBLE, // many independent simulations, one per task, no barriers
+    MODE_SIMD, // many independent simulations, one per SIMD lane
+    MODE_GRID, // one simulation over a landscape of cells
+    MODE_COROUTINES // the sections agents as coroutines on one thread
+};
+
+const char* ModeNames[] = { "sections", "double", "agents", "ensemble", "simd", "grid", "coroutines" };
+
 // Function prototypes
-float Ranf(float, float);
 float SQR(float);
-void InitBarrier(int);
-void WaitBarrier();
+int ComputeNumDeer(const State&);
+float ComputeHeight(const State&);
+float ComputeWeedDensity(const State&);
+void ComputeWeather(State&, float, float);
+void ComputeWeather(State&, RngStream);
+void AdvanceMonth(const State&, State&);
+void AdvanceWeather(const State&, State&, RngStream);
+void CopyFields(const State&, State&, unsigned int);
+void RecordRow(const State&, const State&);
 void Deer();
 void Grain();
 void Watcher();
 void Weeds();
-
-// Global variables for barrier
-omp_lock_t Lock;
-volatile int NumInThreadTeam;
-volatile int NumAtBarrier;
-volatile int NumGone;
+void DoubleDeer();
+void DoubleGrain();
+void DoubleWatcher();
+void DoubleWeeds();
+void DeerStep(const State&, State&, RngStream);
+void GrainStep(const State&, State&, RngStream);
+void WeatherStep(const State&, State&, RngStream);
+void WeedsStep(const State&, State&, RngStream);
 
 // Global variables for simulation state
-int NowYear; // 2025 - 2030
-int NowMonth; // 0 - 11
-float NowPrecip; // inches of rain per month
-float NowTemp; // temperature this month
-float NowHeight; // grain height in inches
-int NowNumDeer; // number of deer in the current population
-float NowWeedDensity; // density of weeds (0 to 1)
+State Now;
+
+// the weather's random numbers for a single run (set up from the seed in main)
+RngStream WeatherStream;
+
+// Global variables for the double-buffered simulation state:
+// during step n every agent reads Generations[n%2] and writes its
+// own fields of Generations[(n+1)%2]
+State Generations[2];
 
 // Constants
 const float GRAIN_GROWS_PER_MONTH = 12.0;
@@ -55,233 +106,417 @@ const float MAX_WEED_DENSITY = 1.0; // maximum density
 const float WEED_IMPACT_ON_GRAIN = 0.5; // how much weeds reduce grain growth (0-1)
 const float WEED_DEATH_WINTER = 0.7; // how much weeds die off in winter
 
-// Random number generator function
-float Ranf(float low, float high)
+// the simulation stops when this month is reached, counted as Year * 12 + Month
+// (--months= sets it relative to the start; by default the run ends as 2031 begins)
+long long EndMonth = 2031 * 12;
+
+// months since the start of year 0
+inline long long MonthIndex(const State& s)
 {
-    float r = (float)rand(); // 0 - RAND_MAX
-    float t = r / (float)RAND_MAX; // 0. - 1.
+    return (long long)s.Year * 12 + s.Month;
+}
 
-    return low + t * (high - low);
+inline bool Finished(const State& s)
+{
+    return MonthIndex(s) >= EndMonth;
+}
+
+// copy the fields named by mask
+void CopyFields(const State& from, State& to, unsigned int mask)
+{
+    if (mask & FIELD_YEAR)
+        to.Year = from.Year;
+    if (mask & FIELD_MONTH)
+        to.Month = from.Month;
+    if (mask & FIELD_PRECIP)
+        to.Precip = from.Precip;
+    if (mask & FIELD_TEMP)
+        to.Temp = from.Temp;
+    if (mask & FIELD_HEIGHT)
+        to.Height = from.Height;
+    if (mask & FIELD_NUMDEER)
+        to.NumDeer = from.NumDeer;
+    if (mask & FIELD_WEEDDENSITY)
+        to.WeedDensity = from.WeedDensity;
 }
 
+#include "agents.h"
+
 // Squaring function
 float SQR(float x)
 {
     return x * x;
 }
 
-// Barrier functions
-void InitBarrier(int n)
+// next number of deer, based on the current state of the simulation
+int ComputeNumDeer(const State& now)
 {
-    NumInThreadTeam = n;
-    NumAtBarrier = 0;
-    omp_init_lock(&Lock);
+    int nextNumDeer = now.NumDeer;
+    int carryingCapacity = (int)(now.Height);
+    if (nextNumDeer < carryingCapacity)
+        nextNumDeer++;
+    else if (nextNumDeer > carryingCapacity)
+        nextNumDeer--;
+
+    if (nextNumDeer < 0)
+        nextNumDeer = 0;
+
+    return nextNumDeer;
 }
 
-void WaitBarrier()
+// next grain height, based on the current state of the simulation
+float ComputeHeight(const State& now)
 {
-    omp_set_lock(&Lock);
-    {
-        NumAtBarrier++;
-        if (NumAtBarrier == NumInThreadTeam) {
-            NumGone = 0;
-            NumAtBarrier = 0;
-            // let all other threads get back to what they were doing
-            // before this one unlocks, knowing that they might immediately
-            // call WaitBarrier() again:
-            while (NumGone != NumInThreadTeam - 1)
-                ;
-            omp_unset_lock(&Lock);
-            return;
-        }
+    float tempFactor = exp(-SQR((now.Temp - MIDTEMP) / 10.));
+    float precipFactor = exp(-SQR((now.Precip - MIDPRECIP) / 10.));
+
+    float nextHeight = now.Height;
+    // Adjust grain growth based on temperature, precipitation, and weed density
+    nextHeight += tempFactor * precipFactor * GRAIN_GROWS_PER_MONTH * (1.0 - WEED_IMPACT_ON_GRAIN * now.WeedDensity);
+    nextHeight -= (float)now.NumDeer * ONE_DEER_EATS_PER_MONTH;
+
+    if (nextHeight < 0.)
+        nextHeight = 0.;
+
+    return nextHeight;
+}
+
+// next weed density, based on the current state of the simulation
+float ComputeWeedDensity(const State& now)
+{
+    float nextWeedDensity = now.WeedDensity;
+
+    // Weed growth depends on temperature and precipitation
+    // Weeds grow faster in warmer, wetter conditions
+    float tempFactor = exp(-SQR((now.Temp - 70.0) / 30.)); // Weeds prefer warmer temps than grain
+    float precipFactor = exp(-SQR((now.Precip - 8.0) / 10.)); // Weeds prefer slightly less water than ideal for grain
+
+    // Winter die-off (when temperature drops significantly)
+    bool isWinter = (now.Month == 11 || now.Month == 0 || now.Month == 1);
+    float seasonalFactor = isWinter ? (1.0 - WEED_DEATH_WINTER) : 1.0;
+
+    // Update weed density - affected by current conditions and grain height
+    // Weeds grow less if grain is tall (shading effect)
+    float growthRate = WEED_GROWTH_RATE * tempFactor * precipFactor * (1.0 - now.Height / 20.0);
+    nextWeedDensity += growthRate;
+    nextWeedDensity *= seasonalFactor;
+
+    // Ensure weed density is between 0 and MAX_WEED_DENSITY
+    if (nextWeedDensity > MAX_WEED_DENSITY)
+        nextWeedDensity = MAX_WEED_DENSITY;
+    if (nextWeedDensity < 0.0)
+        nextWeedDensity = 0.0;
+
+    return nextWeedDensity;
+}
+
+// temperature and precipitation for the month the state is in, plus the given noise
+void ComputeWeather(State& s, float tempNoise, float precipNoise)
+{
+    float ang = (30. * (float)s.Month + 15.) * (M_PI / 180.); // angle of earth around the sun
+    float temp = AVG_TEMP - AMP_TEMP * cos(ang);
+    s.Temp = temp + tempNoise;
+
+    float precip = AVG_PRECIP_PER_MONTH + AMP_PRECIP_PER_MONTH * sin(ang);
+    s.Precip = precip + precipNoise;
+    if (s.Precip < 0.)
+        s.Precip = 0.;
+}
+
+// weather with noise from the given stream: the numbers drawn depend only on
+// the date, so a month's weather is the same whichever thread draws it and when
+void ComputeWeather(State& s, RngStream stream)
+{
+    uint32_t counter = 2 * (uint32_t)(s.Year * 12 + s.Month);
+    float tempNoise = Ranf(stream, counter, -RANDOM_TEMP, RANDOM_TEMP);
+    float precipNoise = Ranf(stream, counter + 1, -RANDOM_PRECIP, RANDOM_PRECIP);
+    ComputeWeather(s, tempNoise, precipNoise);
+}
+
+// move on to the month after now
+// (next may be the same state as now)
+void AdvanceMonth(const State& now, State& next)
+{
+    int month = now.Month + 1;
+    int year = now.Year;
+    if (month >= 12) {
+        month = 0;
+        year++;
+    }
+
+    next.Month = month;
+    next.Year = year;
+}
+
+// move on to the month after now and draw its weather
+void AdvanceWeather(const State& now, State& next, RngStream stream)
+{
+    AdvanceMonth(now, next);
+    ComputeWeather(next, stream);
+}
+
+// --every=n: one row of means for every n months instead of one row a month
+int RowEvery = 1;
+int RowMonths = 0;
+double RowSums[5]; // Temp, Precip, Height, NumDeer, WeedDensity
+State RowLast; // the last month recorded, which dates the row
+
+// hand the means of the months recorded since the last row to the writer
+void FlushRows()
+{
+    if (RowMonths == 0)
+        return;
+
+    double n = (double)RowMonths;
+    OutputRecord record = { 0, RowLast.Month + 1, RowLast.Year, (float)(RowSums[0] / n), (float)(RowSums[1] / n),
+        (float)(RowSums[2] / n), (int)(RowSums[3] / n + 0.5), (float)(RowSums[4] / n) };
+    WriterPush(0, record);
+
+    RowMonths = 0;
+    memset(RowSums, 0, sizeof(RowSums));
+}
+
+// one row of output: a month's weather and the populations it led to
+// (handed to the writer thread, which formats and writes it while the run goes on)
+void RecordRow(const State& weather, const State& populations)
+{
+    if (RowEvery <= 1) {
+        OutputRecord record = { 0, weather.Month + 1, weather.Year, weather.Temp, weather.Precip,
+            populations.Height, populations.NumDeer, populations.WeedDensity };
+        WriterPush(0, record);
+        return;
     }
-    omp_unset_lock(&Lock);
 
-    while (NumAtBarrier != 0)
-        ; // this waits for the nth thread to arrive
+    RowSums[0] += weather.Temp;
+    RowSums[1] += weather.Precip;
+    RowSums[2] += populations.Height;
+    RowSums[3] += populations.NumDeer;
+    RowSums[4] += populations.WeedDensity;
+    RowLast = weather;
+    if (++RowMonths == RowEvery)
+        FlushRows();
+}
 
-#pragma omp atomic
-    NumGone++; // this flags how many threads have returned
+// run the given number of months on this thread with no barriers and no
+// output, returns the state reached -- the same months any engine would produce
+State FastForward(const State& start, long long months)
+{
+    State now = start;
+    for (long long m = 0; m < months && !Finished(now); m++) {
+        State next;
+        next.NumDeer = ComputeNumDeer(now);
+        next.Height = ComputeHeight(now);
+        next.WeedDensity = ComputeWeedDensity(now);
+        AdvanceWeather(now, next, WeatherStream);
+        now = next;
+    }
+    return now;
 }
 
+#include "ensemble.h"
+#include "simd.h"
+#include "grid.h"
+#include "coroutine.h"
+
 // Deer thread function
 void Deer()
 {
-    while (NowYear < 2031) {
+    TraceName(omp_get_thread_num(), "Deer");
+
+    while (!Finished(Now)) {
         // compute a temporary next-value for this quantity
         // based on the current state of the simulation:
-        int nextNumDeer = NowNumDeer;
-        int carryingCapacity = (int)(NowHeight);
-        if (nextNumDeer < carryingCapacity)
-            nextNumDeer++;
-        else if (nextNumDeer > carryingCapacity)
-            nextNumDeer--;
-
-        if (nextNumDeer < 0)
-            nextNumDeer = 0;
+        int nextNumDeer = ComputeNumDeer(Now);
 
         // DoneComputing barrier:
-        WaitBarrier();
+        WaitBarrier("DoneComputing");
 
         // copy the value into the global variable:
-        NowNumDeer = nextNumDeer;
+        Now.NumDeer = nextNumDeer;
 
         // DoneAssigning barrier:
-        WaitBarrier();
+        WaitBarrier("DoneAssigning");
 
         // DonePrinting barrier:
-        WaitBarrier();
+        WaitBarrier("DonePrinting");
     }
 }
 
 // Grain thread function
 void Grain()
 {
-    while (NowYear < 2031) {
+    TraceName(omp_get_thread_num(), "Grain");
+
+    while (!Finished(Now)) {
         // compute a temporary next-value for this quantity
         // based on the current state of the simulation:
-        float tempFactor = exp(-SQR((NowTemp - MIDTEMP) / 10.));
-        float precipFactor = exp(-SQR((NowPrecip - MIDPRECIP) / 10.));
-
-        float nextHeight = NowHeight;
-        // Adjust grain growth based on temperature, precipitation, and weed density
-        nextHeight += tempFactor * precipFactor * GRAIN_GROWS_PER_MONTH * (1.0 - WEED_IMPACT_ON_GRAIN * NowWeedDensity);
-        nextHeight -= (float)NowNumDeer * ONE_DEER_EATS_PER_MONTH;
-
-        if (nextHeight < 0.)
-            nextHeight = 0.;
+        float nextHeight = ComputeHeight(Now);
 
         // DoneComputing barrier:
-        WaitBarrier();
+        WaitBarrier("DoneComputing");
 
         // copy the value into the global variable:
-        NowHeight = nextHeight;
+        Now.Height = nextHeight;
 
         // DoneAssigning barrier:
-        WaitBarrier();
+        WaitBarrier("DoneAssigning");
 
         // DonePrinting barrier:
-        WaitBarrier();
+        WaitBarrier("DonePrinting");
     }
 }
 
 // Watcher thread function
 void Watcher()
 {
-    // Vector to store data for later display
-    std::vector<std::string> data;
+    TraceName(omp_get_thread_num(), "Watcher");
 
-    // Add header to data
-    data.push_back("Month,Year,Temp,Precip,Height,Deer,WeedDensity");
+    while (!Finished(Now)) {
+        // Calculate the next month, temperature and precipitation -- they
+        // depend only on the date, so this overlaps the other agents' computing:
+        State next = Now;
+        AdvanceWeather(Now, next, WeatherStream);
 
-    while (NowYear < 2031) {
         // DoneComputing barrier:
-        WaitBarrier();
+        WaitBarrier("DoneComputing");
 
         // DoneAssigning barrier:
-        WaitBarrier();
-
-        // print the current state variables:
-        char buffer[256];
-        sprintf(buffer, "%d,%d,%.2f,%.2f,%.2f,%d,%.2f",
-            NowMonth + 1, NowYear, NowTemp, NowPrecip, NowHeight, NowNumDeer, NowWeedDensity);
-        data.push_back(buffer);
-
-        // Calculate the next temperature and precipitation:
-        NowMonth++;
-        if (NowMonth >= 12) {
-            NowMonth = 0;
-            NowYear++;
-        }
+        WaitBarrier("DoneAssigning");
 
-        float ang = (30. * (float)NowMonth + 15.) * (M_PI / 180.); // angle of earth around the sun
-        float temp = AVG_TEMP - AMP_TEMP * cos(ang);
-        NowTemp = temp + Ranf(-RANDOM_TEMP, RANDOM_TEMP);
-
-        float precip = AVG_PRECIP_PER_MONTH + AMP_PRECIP_PER_MONTH * sin(ang);
-        NowPrecip = precip + Ranf(-RANDOM_PRECIP, RANDOM_PRECIP);
-        if (NowPrecip < 0.)
-            NowPrecip = 0.;
+        // record the current state variables and move on to the next month:
+        RecordRow(Now, Now);
+        CopyFields(next, Now, FIELD_YEAR | FIELD_MONTH | FIELD_TEMP | FIELD_PRECIP);
 
         // DonePrinting barrier:
-        WaitBarrier();
-    }
-
-    // Print all collected data at the end
-    for (const std::string& line : data) {
-        std::cout << line << std::endl;
+        WaitBarrier("DonePrinting");
     }
 }
 
 // Weeds thread function
 void Weeds()
 {
-    while (NowYear < 2031) {
-        // Compute next weed density based on current conditions
-        float nextWeedDensity = NowWeedDensity;
-
-        // Weed growth depends on temperature and precipitation
-        // Weeds grow faster in warmer, wetter conditions
-        float tempFactor = exp(-SQR((NowTemp - 70.0) / 30.)); // Weeds prefer warmer temps than grain
-        float precipFactor = exp(-SQR((NowPrecip - 8.0) / 10.)); // Weeds prefer slightly less water than ideal for grain
-
-        // Winter die-off (when temperature drops significantly)
-        bool isWinter = (NowMonth == 11 || NowMonth == 0 || NowMonth == 1);
-        float seasonalFactor = isWinter ? (1.0 - WEED_DEATH_WINTER) : 1.0;
+    TraceName(omp_get_thread_num(), "Weeds");
 
-        // Update weed density - affected by current conditions and grain height
-        // Weeds grow less if grain is tall (shading effect)
-        float growthRate = WEED_GROWTH_RATE * tempFactor * precipFactor * (1.0 - NowHeight / 20.0);
-        nextWeedDensity += growthRate;
-        nextWeedDensity *= seasonalFactor;
-
-        // Ensure weed density is between 0 and MAX_WEED_DENSITY
-        if (nextWeedDensity > MAX_WEED_DENSITY)
-            nextWeedDensity = MAX_WEED_DENSITY;
-        if (nextWeedDensity < 0.0)
-            nextWeedDensity = 0.0;
+    while (!Finished(Now)) {
+        // Compute next weed density based on current conditions
+        float nextWeedDensity = ComputeWeedDensity(Now);
 
         // DoneComputing barrier:
-        WaitBarrier();
+        WaitBarrier("DoneComputing");
 
         // copy the value into the global variable:
-        NowWeedDensity = nextWeedDensity;
+        Now.WeedDensity = nextWeedDensity;
 
         // DoneAssigning barrier:
-        WaitBarrier();
+        WaitBarrier("DoneAssigning");
 
         // DonePrinting barrier:
-        WaitBarrier();
+        WaitBarrier("DonePrinting");
     }
 }
 
-int main(int argc, char* argv[])
+// Double-buffered Deer thread function
+void DoubleDeer()
 {
-    // Starting date and time:
-    NowMonth = 0;
-    NowYear = 2025;
+    TraceName(omp_get_thread_num(), "Deer");
 
-    // Starting state:
-    NowNumDeer = 2;
-    NowHeight = 5.;
-    NowWeedDensity = 0.1; // Initial weed density
+    for (int step = 0; !Finished(Generations[step % 2]); step++) {
+        const State& now = Generations[step % 2];
+        State& next = Generations[(step + 1) % 2];
 
-    // Create initial temperature and precipitation
-    float ang = (30. * (float)NowMonth + 15.) * (M_PI / 180.); // angle of earth around the sun
-    float temp = AVG_TEMP - AMP_TEMP * cos(ang);
-    NowTemp = temp + Ranf(-RANDOM_TEMP, RANDOM_TEMP);
+        next.NumDeer = ComputeNumDeer(now);
 
-    float precip = AVG_PRECIP_PER_MONTH + AMP_PRECIP_PER_MONTH * sin(ang);
-    NowPrecip = precip + Ranf(-RANDOM_PRECIP, RANDOM_PRECIP);
-    if (NowPrecip < 0.)
-        NowPrecip = 0.;
+        // DoneStepping barrier:
+        WaitBarrier("DoneStepping");
+    }
+}
 
-    // Initialize random number generator
-    srand(seed);
+// Double-buffered Grain thread function
+void DoubleGrain()
+{
+    TraceName(omp_get_thread_num(), "Grain");
 
-    // Set up the barrier
-    omp_set_num_threads(4); // Number of threads to use
-    InitBarrier(4);
+    for (int step = 0; !Finished(Generations[step % 2]); step++) {
+        const State& now = Generations[step % 2];
+        State& next = Generations[(step + 1) % 2];
+
+        next.Height = ComputeHeight(now);
+
+        // DoneStepping barrier:
+        WaitBarrier("DoneStepping");
+    }
+}
+
+// Double-buffered Watcher thread function:
+// the populations in generation n+1 go with the weather of generation n,
+// so each row is recorded one step late, once the populations are known
+void DoubleWatcher()
+{
+    TraceName(omp_get_thread_num(), "Watcher");
+
+    State previous = Generations[0];
+    for (int step = 0;; step++) {
+        const State& now = Generations[step % 2];
+        State& next = Generations[(step + 1) % 2];
+
+        // record the previous month's weather with the current populations:
+        if (step > 0)
+            RecordRow(previous, now);
+
+        if (Finished(now))
+            break;
+        previous = now;
+
+        // Calculate the next month, temperature and precipitation:
+        AdvanceWeather(now, next, WeatherStream);
+
+        // DoneStepping barrier:
+        WaitBarrier("DoneStepping");
+    }
+}
+
+// Double-buffered Weeds thread function
+void DoubleWeeds()
+{
+    TraceName(omp_get_thread_num(), "Weeds");
+
+    for (int step = 0; !Finished(Generations[step % 2]); step++) {
+        const State& now = Generations[step % 2];
+        State& next = Generations[(step + 1) % 2];
+
+        next.WeedDensity = ComputeWeedDensity(now);
+
+        // DoneStepping barrier:
+        WaitBarrier("DoneStepping");
+    }
+}
+
+// Agent step functions for the agent runtime
+// (each agent is handed its own random number stream):
+void DeerStep(const State& now, State& next, RngStream)
+{
+    next.NumDeer = ComputeNumDeer(now);
+}
+
+void GrainStep(const State& now, State& next, RngStream)
+{
+    next.Height = ComputeHeight(now);
+}
+
+void WeatherStep(const State& now, State& next, RngStream stream)
+{
+    AdvanceWeather(now, next, stream);
+}
+
+void WeedsStep(const State& now, State& next, RngStream)
+{
+    next.WeedDensity = ComputeWeedDensity(now);
+}
+
+// run the simulation from the given state, returns the final state
+State RunSections(const State& start)
+{
+    Now = start;
 
 // Setup and launch parallel sections
 #pragma omp parallel sections
@@ -308,5 +543,256 @@ int main(int argc, char* argv[])
     } // implied barrier -- all functions must return in order
       // to allow any of them to get past here
 
+    return Now;
+}
+
+// run the simulation from the given state, returns the final state
+State RunDouble(const State& start)
+{
+    Generations[0] = start;
+    Generations[1] = start;
+
+#pragma omp parallel sections
+    {
+#pragma omp section
+        {
+            DoubleDeer();
+        }
+
+#pragma omp section
+        {
+            DoubleGrain();
+        }
+
+#pragma omp section
+        {
+            DoubleWatcher();
+        }
+
+#pragma omp section
+        {
+            DoubleWeeds();
+        }
+    }
+
+    // the generation that ended the run:
+    return Finished(Generations[0]) ? Generations[0] : Generations[1];
+}
+
+// user + system CPU seconds used by the whole process so far
+double CpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1000000.
+        + (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1000000.;
+}
+
+int main(int argc, char* argv[])
+{
+    // pick the engine and the barrier implementation, e.g. ./main --mode=double --barrier=futex
+    Mode mode = MODE_SECTIONS;
+    int maxThreads = 0; // 0 = as many as the agent runtime finds useful
+    bool listAgents = false;
+    int members = 10000; // for --mode=ensemble
+    const char* outputPath = "-";
+    const char* tracePath = NULL;
+    long long horizon = 0; // months to run; 0 = until 2031
+    long long warmup = 0; // months to fast-forward through before the engine starts
+    OutputFormat outputFormat = FORMAT_CSV;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--barrier=", 10) == 0 && ParseBarrierType(argv[i] + 10, &BarrierKind))
+            continue;
+        if (strncmp(argv[i], "--mode=", 7) == 0) {
+            int m;
+            for (m = 0; m < (int)(sizeof(ModeNames) / sizeof(ModeNames[0])); m++) {
+                if (strcmp(argv[i] + 7, ModeNames[m]) == 0)
+                    break;
+            }
+            if (m < (int)(sizeof(ModeNames) / sizeof(ModeNames[0]))) {
+                mode = (Mode)m;
+                continue;
+            }
+        }
+        if (strncmp(argv[i], "--threads=", 10) == 0 && (maxThreads = atoi(argv[i] + 10)) > 0)
+            continue;
+        if (strncmp(argv[i], "--members=", 10) == 0 && (members = atoi(argv[i] + 10)) > 0)
+            continue;
+        if (strncmp(argv[i], "--width=", 8) == 0 && (GridWidth = atoi(argv[i] + 8)) > 0)
+            continue;
+        if (strncmp(argv[i], "--height=", 9) == 0 && (GridHeight = atoi(argv[i] + 9)) > 0)
+            continue;
+        if (strncmp(argv[i], "--output=", 9) == 0 && argv[i][9] != '\0') {
+            outputPath = argv[i] + 9;
+            continue;
+        }
+        if (strncmp(argv[i], "--months=", 9) == 0 && (horizon = atoll(argv[i] + 9)) > 0)
+            continue;
+        if (strncmp(argv[i], "--warmup=", 9) == 0 && (warmup = atoll(argv[i] + 9)) > 0)
+            continue;
+        if (strncmp(argv[i], "--every=", 8) == 0 && (RowEvery = atoi(argv[i] + 8)) > 0)
+            continue;
+        if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8] != '\0') {
+            tracePath = argv[i] + 8;
+            continue;
+        }
+        if (strcmp(argv[i], "--format=csv") == 0 || strcmp(argv[i], "--format=binary") == 0) {
+            outputFormat = (strcmp(argv[i], "--format=csv") == 0) ? FORMAT_CSV : FORMAT_BINARY;
+            continue;
+        }
+        if (strncmp(argv[i], "--seed=", 7) == 0 && argv[i][7] != '\0') {
+            char* end;
+            seed = (unsigned int)strtoul(argv[i] + 7, &end, 0);
+            if (*end == '\0')
+                continue;
+        }
+        if (strcmp(argv[i], "--list-agents") == 0) {
+            listAgents = true;
+            continue;
+        }
+        fprintf(stderr, "Usage: %s [--mode=sections|double|agents|ensemble|simd|grid|coroutines] [--barrier=lock|spin|futex|pthread] [--threads=n] [--members=n] [--width=n] [--height=n] [--output=file] [--format=csv|binary] [--seed=n] [--months=n] [--warmup=n] [--every=n] [--trace=file.json] [--list-agents]\n", argv[0]);
+        return 1;
+    }
+
+    if (tracePath != NULL && mode != MODE_SECTIONS && mode != MODE_DOUBLE && mode != MODE_AGENTS) {
+        fprintf(stderr, "--trace is for the engines that wait at barriers: sections, double and agents\n");
+        return 1;
+    }
+
+    if (warmup > 0 && (mode == MODE_ENSEMBLE || mode == MODE_SIMD || mode == MODE_GRID)) {
+        fprintf(stderr, "--warmup is for the engines that run a single trajectory\n");
+        return 1;
+    }
+
+    // every ensemble thread streaming to a file pushes into a writer ring of its own:
+    if (mode == MODE_ENSEMBLE && strcmp(outputPath, "-") != 0 && maxThreads > MAX_WRITER_RINGS) {
+        fprintf(stderr, "--mode=ensemble with --output can use at most %d threads\n", MAX_WRITER_RINGS);
+        return 1;
+    }
+
+#ifndef HAVE_COROUTINES
+    if (mode == MODE_COROUTINES) {
+        fprintf(stderr, "--mode=coroutines needs a C++20 build (-std=c++20)\n");
+        return 1;
+    }
+#endif
+
+    // the agents for --mode=agents -- adding a species is one more line here:
+    bool registered = RegisterAgent("Deer", FIELD_HEIGHT | FIELD_NUMDEER, FIELD_NUMDEER, 1.0, DeerStep)
+        && RegisterAgent("Grain", FIELD_TEMP | FIELD_PRECIP | FIELD_HEIGHT | FIELD_NUMDEER | FIELD_WEEDDENSITY, FIELD_HEIGHT, 2.0, GrainStep)
+        && RegisterAgent("Weather", FIELD_YEAR | FIELD_MONTH, FIELD_YEAR | FIELD_MONTH | FIELD_TEMP | FIELD_PRECIP, 2.0, WeatherStep)
+        && RegisterAgent("Weeds", FIELD_MONTH | FIELD_TEMP | FIELD_PRECIP | FIELD_HEIGHT | FIELD_WEEDDENSITY, FIELD_WEEDDENSITY, 2.0, WeedsStep);
+    if (!registered || (mode == MODE_AGENTS && !ValidateAgents()))
+        return 1;
+    AgentObserver = RecordRow;
+
+    State start;
+
+    // Starting date and time:
+    start.Month = 0;
+    start.Year = 2025;
+
+    // Starting state:
+    start.NumDeer = 2;
+    start.Height = 5.;
+    start.WeedDensity = 0.1; // Initial weed density
+
+    // Initialize the random number streams -- the Weather agent's own stream
+    // is the same one, so every engine draws the same weather for a seed:
+    WeatherStream = MakeStream(seed, 0, "Weather");
+
+    // Create initial temperature and precipitation
+    ComputeWeather(start, WeatherStream);
+
+    // the horizon:
+    if (horizon > 0)
+        EndMonth = MonthIndex(start) + horizon;
+    if ((mode == MODE_ENSEMBLE || mode == MODE_SIMD) && !EnsembleFits(start, members))
+        return 1;
+
+    // Set up the barrier
+    omp_set_num_threads(4); // Number of threads to use
+    InitBarrier(4);
+
+    // the rows go to the writer thread: one ring for a single run, or one per
+    // ensemble thread when every member's trajectory is streamed to a file
+    bool isEnsemble = (mode == MODE_ENSEMBLE || mode == MODE_SIMD);
+    bool writing = !isEnsemble || (mode == MODE_ENSEMBLE && strcmp(outputPath, "-") != 0);
+    if (writing) {
+        EnsembleStream = isEnsemble;
+        if (isEnsemble && maxThreads == 0 && omp_get_num_procs() > MAX_WRITER_RINGS)
+            maxThreads = MAX_WRITER_RINGS;
+        int numRings = isEnsemble ? ((maxThreads > 0) ? maxThreads : omp_get_num_procs()) : 1;
+        if (!WriterOpen(outputPath, outputFormat, numRings, isEnsemble))
+            return 1;
+    }
+
+    // a buffer for every thread that will wait at the barriers:
+    if (tracePath != NULL)
+        TraceOpen((mode == MODE_AGENTS) ? AgentThreads(maxThreads) : 4);
+
+    double time0 = omp_get_wtime();
+    double cpu0 = CpuSeconds();
+
+    // the warm-up is run on this thread with no barriers and no output,
+    // and the engine carries on from where it got to:
+    State from = (warmup > 0) ? FastForward(start, warmup) : start;
+
+    State end;
+#ifdef HAVE_COROUTINES
+    if (mode == MODE_COROUTINES)
+        end = RunCoroutines(from);
+    else
+#endif
+    if (mode == MODE_GRID)
+        end = RunGrid(from, maxThreads);
+    else if (mode == MODE_SIMD)
+        end = RunSimdEnsemble(from, members, maxThreads);
+    else if (mode == MODE_ENSEMBLE)
+        end = RunEnsemble(from, members, maxThreads);
+    else if (mode == MODE_AGENTS)
+        end = RunAgents(from, maxThreads);
+    else if (mode == MODE_DOUBLE)
+        end = RunDouble(from);
+    else
+        end = RunSections(from);
+
+    double time1 = omp_get_wtime();
+    double cpu1 = CpuSeconds();
+
+    if (writing && !isEnsemble)
+        FlushRows();
+    long long writerStalls = writing ? WriterClose() : 0;
+    if (tracePath != NULL) {
+        long long dropped = TraceWrite(tracePath);
+        if (dropped > 0)
+            fprintf(stderr, "Trace: %lld barrier waits did not fit in TRACE_EVENTS_PER_THREAD\n", dropped);
+    }
+    if (isEnsemble)
+        PrintEnsemble(start, stdout);
+    if (listAgents && mode == MODE_AGENTS)
+        PrintAgents(stderr);
+
+    // report how fast the engine stepped and how much the barriers cost over the whole run:
+    // Mode,Barrier,Threads,Members,Months,WallSeconds,CpuSeconds,MemberMonthsPerSecond,SimulationsPerSecond,
+    // BarrierCalls,MeanWaitMicroseconds,MaxWaitMicroseconds,WriterStalls
+    BarrierStats stats = SumBarrierStats();
+#ifdef HAVE_COROUTINES
+    // (a coroutine's barrier wait is not timed, it is only a switch to the next agent)
+    if (mode == MODE_COROUTINES)
+        stats.calls = CoBarrierCalls;
+#endif
+    // (for the landscape every cell counts as a member, so MemberMonthsPerSecond is cell-updates/sec)
+    double numMembers = isEnsemble ? (double)EnsembleMembers : (mode == MODE_GRID) ? (double)GridWidth * (double)GridHeight : 1.;
+    long long numMonths = MonthIndex(end) - MonthIndex(start);
+    double meanWait = (stats.calls > 0) ? stats.waitSeconds / (double)stats.calls : 0.;
+    bool threadBarrier = !isEnsemble && mode != MODE_GRID && mode != MODE_COROUTINES;
+    fprintf(stderr, "%s,%s,%d,%.0lf,%lld,%.6lf,%.6lf,%.1lf,%.1lf,%lld,%.3lf,%.3lf,%lld\n",
+        ModeNames[mode], (mode == MODE_SIMD) ? SIMD_NAME : (mode == MODE_COROUTINES) ? "coroutine" : threadBarrier ? BarrierNames[BarrierKind] : "none",
+        isEnsemble ? EnsembleThreads : (mode == MODE_GRID) ? GridThreads : (mode == MODE_COROUTINES) ? 1 : (int)NumInThreadTeam,
+        numMembers, numMonths, time1 - time0, cpu1 - cpu0,
+        numMembers * (double)numMonths / (time1 - time0), numMembers / (time1 - time0),
+        stats.calls, 1000000. * meanWait, 1000000. * stats.maxWaitSeconds, writerStalls);
+
     return 0;
 }
@@ -0,0 +1,61 @@
+#ifndef RNG_H
+#define RNG_H
+
+// The random number streams.
+// Counter-based: the n-th number of a stream is a keyed hash of n, so a stream
+// has no state to carry or share -- any thread can draw any number of any
+// stream in any order and always get the same value. Every agent, every
+// ensemble member and the landscape's starting cells get their own stream,
+// keyed by the run's seed, the member and the stream's name, which makes a
+// run reproducible from --seed alone whatever the threads and the engine.
+//
+// The hash uses only 32-bit multiplies, shifts and xors, so the SIMD engine
+// draws the same numbers in its lanes as the scalar engines do.
+
+#include <stdint.h>
+
+struct RngStream {
+    uint32_t Key0; // from the seed and the stream's name
+    uint32_t Key1; // from Key0 and the member
+};
+
+// a well-mixed 32-bit hash (every input bit affects every output bit)
+inline uint32_t RngMix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// the stream called name for the given member of the run with the given seed
+// (a single run is member 0)
+RngStream MakeStream(unsigned int runSeed, unsigned int member, const char* name)
+{
+    uint32_t h = 2166136261u; // FNV-1a of the name
+    for (const char* c = name; *c != '\0'; c++)
+        h = (h ^ (unsigned char)*c) * 16777619u;
+
+    RngStream stream;
+    stream.Key0 = RngMix(runSeed ^ RngMix(h));
+    stream.Key1 = RngMix(stream.Key0 + (member + 1) * 0x9e3779b9u);
+    return stream;
+}
+
+// the counter-th 32 random bits of the stream
+inline uint32_t RandomBits(RngStream stream, uint32_t counter)
+{
+    return RngMix(RngMix(counter ^ stream.Key0) + stream.Key1);
+}
+
+// the counter-th number of the stream, uniform in [low, high)
+inline float Ranf(RngStream stream, uint32_t counter, float low, float high)
+{
+    float t = (float)(RandomBits(stream, counter) >> 8) * (1.f / 16777216.f); // 0. - 1.
+
+    return low + t * (high - low);
+}
+
+#endif // RNG_H
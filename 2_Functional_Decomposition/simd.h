@@ -0,0 +1,298 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// The SIMD ensemble engine.
+// The per-month update is tiny for one simulation but identical across
+// simulations, so this engine puts one ensemble member in each SIMD lane:
+// Grain, Weeds and the weather are advanced for SIMD_WIDTH members per
+// instruction with a vectorized exp(), masked clamping and a vector integer
+// deer update. Each member's state stays in registers for the whole run and
+// every month is stored straight into the member-contiguous EnsembleValues
+// columns, so PrintEnsemble() reports it the same way as --mode=ensemble.
+//
+// Compile with -DUSE_AVX512 -mavx512f for 16 lanes or -DUSE_AVX -mavx2 -mfma
+// for 8 lanes. Without either the same kernel runs on 8 scalar lanes.
+//
+// Include this after ensemble.h.
+
+#if defined(USE_AVX512) || defined(USE_AVX)
+#include <immintrin.h>
+#endif
+
+#define VINLINE static inline __attribute__((always_inline))
+
+#if defined(USE_AVX512)
+
+#define SIMD_WIDTH 16
+#define SIMD_NAME "avx512"
+
+typedef __m512 VecF;
+typedef __m512i VecI;
+typedef __mmask16 VecMask;
+
+VINLINE VecF VSet(float a) { return _mm512_set1_ps(a); }
+VINLINE VecI VISet(int a) { return _mm512_set1_epi32(a); }
+VINLINE VecI VILoad(const unsigned int* p) { return _mm512_loadu_si512((const void*)p); }
+VINLINE void VStore(float* p, VecF a) { _mm512_storeu_ps(p, a); }
+VINLINE VecF VAdd(VecF a, VecF b) { return _mm512_add_ps(a, b); }
+VINLINE VecF VSub(VecF a, VecF b) { return _mm512_sub_ps(a, b); }
+VINLINE VecF VMul(VecF a, VecF b) { return _mm512_mul_ps(a, b); }
+VINLINE VecF VFma(VecF a, VecF b, VecF c) { return _mm512_fmadd_ps(a, b, c); } // a*b + c
+VINLINE VecF VMax(VecF a, VecF b) { return _mm512_max_ps(a, b); }
+VINLINE VecF VMin(VecF a, VecF b) { return _mm512_min_ps(a, b); }
+VINLINE VecF VFloor(VecF a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+VINLINE VecMask VCmpLt(VecF a, VecF b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+VINLINE VecF VSelect(VecMask m, VecF a, VecF b) { return _mm512_mask_blend_ps(m, b, a); } // m ? a : b
+VINLINE VecI VIAdd(VecI a, VecI b) { return _mm512_add_epi32(a, b); }
+VINLINE VecI VISub(VecI a, VecI b) { return _mm512_sub_epi32(a, b); }
+VINLINE VecI VIMax(VecI a, VecI b) { return _mm512_max_epi32(a, b); }
+VINLINE VecMask VICmpLt(VecI a, VecI b) { return _mm512_cmplt_epi32_mask(a, b); }
+VINLINE VecI VISelect(VecMask m, VecI a, VecI b) { return _mm512_mask_blend_epi32(m, b, a); }
+VINLINE VecI VIMul(VecI a, VecI b) { return _mm512_mullo_epi32(a, b); }
+VINLINE VecI VIXor(VecI a, VecI b) { return _mm512_xor_si512(a, b); }
+VINLINE VecI VIShl(VecI a, int n) { return _mm512_slli_epi32(a, n); }
+VINLINE VecI VIShr(VecI a, int n) { return _mm512_srli_epi32(a, n); }
+VINLINE VecI VTrunc(VecF a) { return _mm512_cvttps_epi32(a); }
+VINLINE VecF VToF(VecI a) { return _mm512_cvtepi32_ps(a); }
+VINLINE VecF VAsF(VecI a) { return _mm512_castsi512_ps(a); }
+
+#elif defined(USE_AVX)
+
+#define SIMD_WIDTH 8
+#define SIMD_NAME "avx2"
+
+typedef __m256 VecF;
+typedef __m256i VecI;
+typedef __m256i VecMask; // all ones in the lanes where the comparison held
+
+VINLINE VecF VSet(float a) { return _mm256_set1_ps(a); }
+VINLINE VecI VISet(int a) { return _mm256_set1_epi32(a); }
+VINLINE VecI VILoad(const unsigned int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+VINLINE void VStore(float* p, VecF a) { _mm256_storeu_ps(p, a); }
+VINLINE VecF VAdd(VecF a, VecF b) { return _mm256_add_ps(a, b); }
+VINLINE VecF VSub(VecF a, VecF b) { return _mm256_sub_ps(a, b); }
+VINLINE VecF VMul(VecF a, VecF b) { return _mm256_mul_ps(a, b); }
+VINLINE VecF VFma(VecF a, VecF b, VecF c) { return _mm256_fmadd_ps(a, b, c); } // a*b + c
+VINLINE VecF VMax(VecF a, VecF b) { return _mm256_max_ps(a, b); }
+VINLINE VecF VMin(VecF a, VecF b) { return _mm256_min_ps(a, b); }
+VINLINE VecF VFloor(VecF a) { return _mm256_floor_ps(a); }
+VINLINE VecMask VCmpLt(VecF a, VecF b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+VINLINE VecF VSelect(VecMask m, VecF a, VecF b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(m)); } // m ? a : b
+VINLINE VecI VIAdd(VecI a, VecI b) { return _mm256_add_epi32(a, b); }
+VINLINE VecI VISub(VecI a, VecI b) { return _mm256_sub_epi32(a, b); }
+VINLINE VecI VIMax(VecI a, VecI b) { return _mm256_max_epi32(a, b); }
+VINLINE VecMask VICmpLt(VecI a, VecI b) { return _mm256_cmpgt_epi32(b, a); }
+VINLINE VecI VISelect(VecMask m, VecI a, VecI b) { return _mm256_blendv_epi8(b, a, m); }
+VINLINE VecI VIMul(VecI a, VecI b) { return _mm256_mullo_epi32(a, b); }
+VINLINE VecI VIXor(VecI a, VecI b) { return _mm256_xor_si256(a, b); }
+VINLINE VecI VIShl(VecI a, int n) { return _mm256_slli_epi32(a, n); }
+VINLINE VecI VIShr(VecI a, int n) { return _mm256_srli_epi32(a, n); }
+VINLINE VecI VTrunc(VecF a) { return _mm256_cvttps_epi32(a); }
+VINLINE VecF VToF(VecI a) { return _mm256_cvtepi32_ps(a); }
+VINLINE VecF VAsF(VecI a) { return _mm256_castsi256_ps(a); }
+
+#else
+
+// no vector instruction set was asked for: plain arrays of lanes,
+// which the compiler is free to auto-vectorize
+#define SIMD_WIDTH 8
+#define SIMD_NAME "scalar"
+
+struct VecF {
+    float v[SIMD_WIDTH];
+};
+struct VecI {
+    int v[SIMD_WIDTH];
+};
+struct VecMask {
+    bool v[SIMD_WIDTH];
+};
+
+#define LANES(expr)                           \
+    for (int l = 0; l < SIMD_WIDTH; l++) { \
+        expr;                                 \
+    }
+
+VINLINE VecF VSet(float a) { VecF r; LANES(r.v[l] = a) return r; }
+VINLINE VecI VISet(int a) { VecI r; LANES(r.v[l] = a) return r; }
+VINLINE VecI VILoad(const unsigned int* p) { VecI r; LANES(r.v[l] = (int)p[l]) return r; }
+VINLINE void VStore(float* p, VecF a) { LANES(p[l] = a.v[l]) }
+VINLINE VecF VAdd(VecF a, VecF b) { VecF r; LANES(r.v[l] = a.v[l] + b.v[l]) return r; }
+VINLINE VecF VSub(VecF a, VecF b) { VecF r; LANES(r.v[l] = a.v[l] - b.v[l]) return r; }
+VINLINE VecF VMul(VecF a, VecF b) { VecF r; LANES(r.v[l] = a.v[l] * b.v[l]) return r; }
+VINLINE VecF VFma(VecF a, VecF b, VecF c) { VecF r; LANES(r.v[l] = a.v[l] * b.v[l] + c.v[l]) return r; }
+VINLINE VecF VMax(VecF a, VecF b) { VecF r; LANES(r.v[l] = a.v[l] > b.v[l] ? a.v[l] : b.v[l]) return r; }
+VINLINE VecF VMin(VecF a, VecF b) { VecF r; LANES(r.v[l] = a.v[l] < b.v[l] ? a.v[l] : b.v[l]) return r; }
+VINLINE VecF VFloor(VecF a) { VecF r; LANES(r.v[l] = floorf(a.v[l])) return r; }
+VINLINE VecMask VCmpLt(VecF a, VecF b) { VecMask r; LANES(r.v[l] = a.v[l] < b.v[l]) return r; }
+VINLINE VecF VSelect(VecMask m, VecF a, VecF b) { VecF r; LANES(r.v[l] = m.v[l] ? a.v[l] : b.v[l]) return r; }
+VINLINE VecI VIAdd(VecI a, VecI b) { VecI r; LANES(r.v[l] = a.v[l] + b.v[l]) return r; }
+VINLINE VecI VISub(VecI a, VecI b) { VecI r; LANES(r.v[l] = a.v[l] - b.v[l]) return r; }
+VINLINE VecI VIMax(VecI a, VecI b) { VecI r; LANES(r.v[l] = a.v[l] > b.v[l] ? a.v[l] : b.v[l]) return r; }
+VINLINE VecMask VICmpLt(VecI a, VecI b) { VecMask r; LANES(r.v[l] = a.v[l] < b.v[l]) return r; }
+VINLINE VecI VISelect(VecMask m, VecI a, VecI b) { VecI r; LANES(r.v[l] = m.v[l] ? a.v[l] : b.v[l]) return r; }
+VINLINE VecI VIMul(VecI a, VecI b) { VecI r; LANES(r.v[l] = (int)((unsigned int)a.v[l] * (unsigned int)b.v[l])) return r; }
+VINLINE VecI VIXor(VecI a, VecI b) { VecI r; LANES(r.v[l] = a.v[l] ^ b.v[l]) return r; }
+VINLINE VecI VIShl(VecI a, int n) { VecI r; LANES(r.v[l] = (int)((unsigned int)a.v[l] << n)) return r; }
+VINLINE VecI VIShr(VecI a, int n) { VecI r; LANES(r.v[l] = (int)((unsigned int)a.v[l] >> n)) return r; }
+VINLINE VecI VTrunc(VecF a) { VecI r; LANES(r.v[l] = (int)a.v[l]) return r; }
+VINLINE VecF VToF(VecI a) { VecF r; LANES(r.v[l] = (float)a.v[l]) return r; }
+VINLINE VecF VAsF(VecI a) { VecF r; LANES(memcpy(&r.v[l], &a.v[l], sizeof(float))) return r; }
+
+#endif
+
+// exp(x) for x <= 0, to about 1 part in 10^7 (the Cephes expf polynomial):
+// x = n*ln2 + r with |r| <= ln2/2, exp(r) from a polynomial, and 2^n put straight
+// into the exponent bits
+VINLINE VecF VExp(VecF x)
+{
+    x = VMax(x, VSet(-87.f)); // below this 2^n is no longer a normal float
+
+    VecF n = VFloor(VFma(x, VSet(1.44269504088896341f), VSet(0.5f)));
+    VecF r = VSub(x, VMul(n, VSet(0.693359375f)));
+    r = VSub(r, VMul(n, VSet(-2.12194440e-4f)));
+
+    VecF p = VSet(1.9875691500e-4f);
+    p = VFma(p, r, VSet(1.3981999507e-3f));
+    p = VFma(p, r, VSet(8.3334519073e-3f));
+    p = VFma(p, r, VSet(4.1665795894e-2f));
+    p = VFma(p, r, VSet(1.6666665459e-1f));
+    p = VFma(p, r, VSet(5.0000001201e-1f));
+    p = VFma(p, VMul(r, r), VAdd(r, VSet(1.f)));
+
+    VecF scale = VAsF(VIShl(VIAdd(VTrunc(n), VISet(127)), 23));
+    return VMul(p, scale);
+}
+
+// RngMix() in every lane
+VINLINE VecI VRngMix(VecI x)
+{
+    x = VIXor(x, VIShr(x, 16));
+    x = VIMul(x, VISet((int)0x7feb352du));
+    x = VIXor(x, VIShr(x, 15));
+    x = VIMul(x, VISet((int)0x846ca68bu));
+    x = VIXor(x, VIShr(x, 16));
+    return x;
+}
+
+// Ranf() in every lane: the counter-th number of each lane's stream, uniform in [low, high)
+VINLINE VecF VRanf(VecI key0, VecI key1, uint32_t counter, float low, float high)
+{
+    VecI bits = VRngMix(VIAdd(VRngMix(VIXor(VISet((int)counter), key0)), key1));
+    VecF t = VMul(VToF(VIShr(bits, 8)), VSet(1.f / 16777216.f)); // 0. - 1.
+    return VAdd(VSet(low), VMul(t, VSet(high - low)));
+}
+
+// SIMD_WIDTH members, starting at member first, from start to EndMonth
+void RunSimdGroup(const State& start, int first, const float* baseTemp, const float* basePrecip, const float* seasonal)
+{
+    // every lane draws from its member's weather stream, the same numbers as --mode=ensemble:
+    unsigned int keys0[SIMD_WIDTH], keys1[SIMD_WIDTH];
+    for (int l = 0; l < SIMD_WIDTH; l++) {
+        RngStream weather = MakeStream(seed, first + l, "Weather");
+        keys0[l] = weather.Key0;
+        keys1[l] = weather.Key1;
+    }
+    VecI key0 = VILoad(keys0);
+    VecI key1 = VILoad(keys1);
+    uint32_t counter = 2 * (uint32_t)(start.Year * 12 + start.Month); // as in ComputeWeather()
+
+    VecF height = VSet(start.Height);
+    VecI numDeer = VISet(start.NumDeer);
+    VecF weedDensity = VSet(start.WeedDensity);
+
+    VecF temp = VAdd(VSet(baseTemp[0]), VRanf(key0, key1, counter, -RANDOM_TEMP, RANDOM_TEMP));
+    VecF precip = VMax(VAdd(VSet(basePrecip[0]), VRanf(key0, key1, counter + 1, -RANDOM_PRECIP, RANDOM_PRECIP)), VSet(0.f));
+
+    for (int month = 0; month < EnsembleMonths; month++) {
+        // Grain and Weeds: exp(a) * exp(b) is done as exp(a + b), one exp per quantity
+        VecF dt = VMul(VSub(temp, VSet(MIDTEMP)), VSet(1.f / 10.f));
+        VecF dp = VMul(VSub(precip, VSet(MIDPRECIP)), VSet(1.f / 10.f));
+        VecF grainFactors = VExp(VSub(VSet(0.f), VFma(dt, dt, VMul(dp, dp))));
+
+        VecF wt = VMul(VSub(temp, VSet(70.f)), VSet(1.f / 30.f));
+        VecF wp = VMul(VSub(precip, VSet(8.f)), VSet(1.f / 10.f));
+        VecF weedFactors = VExp(VSub(VSet(0.f), VFma(wt, wt, VMul(wp, wp))));
+
+        VecF growth = VMul(grainFactors, VFma(weedDensity, VSet(-GRAIN_GROWS_PER_MONTH * WEED_IMPACT_ON_GRAIN), VSet(GRAIN_GROWS_PER_MONTH)));
+        VecF nextHeight = VSub(VAdd(height, growth), VMul(VToF(numDeer), VSet(ONE_DEER_EATS_PER_MONTH)));
+        nextHeight = VMax(nextHeight, VSet(0.f));
+
+        VecF shade = VFma(height, VSet(-1.f / 20.f), VSet(1.f));
+        VecF nextWeedDensity = VFma(VSet(WEED_GROWTH_RATE), VMul(weedFactors, shade), weedDensity);
+        nextWeedDensity = VMul(nextWeedDensity, VSet(seasonal[month]));
+        nextWeedDensity = VMin(VMax(nextWeedDensity, VSet(0.f)), VSet(MAX_WEED_DENSITY));
+
+        // Deer: one step toward the carrying capacity, never below zero
+        VecI carryingCapacity = VTrunc(height);
+        VecI nextNumDeer = VISelect(VICmpLt(numDeer, carryingCapacity), VIAdd(numDeer, VISet(1)), numDeer);
+        nextNumDeer = VISelect(VICmpLt(carryingCapacity, numDeer), VISub(numDeer, VISet(1)), nextNumDeer);
+        nextNumDeer = VIMax(nextNumDeer, VISet(0));
+
+        // the same row the Watcher prints: this month's weather, next month's populations
+        float* values = &EnsembleValues[(size_t)month * NUMVARS * EnsembleMembers + first];
+        VStore(values + (size_t)VAR_TEMP * EnsembleMembers, temp);
+        VStore(values + (size_t)VAR_PRECIP * EnsembleMembers, precip);
+        VStore(values + (size_t)VAR_HEIGHT * EnsembleMembers, nextHeight);
+        VStore(values + (size_t)VAR_NUMDEER * EnsembleMembers, VToF(nextNumDeer));
+        VStore(values + (size_t)VAR_WEEDDENSITY * EnsembleMembers, nextWeedDensity);
+
+        height = nextHeight;
+        numDeer = nextNumDeer;
+        weedDensity = nextWeedDensity;
+
+        // next month's weather, with the precipitation clamped at zero:
+        counter += 2;
+        temp = VAdd(VSet(baseTemp[month + 1]), VRanf(key0, key1, counter, -RANDOM_TEMP, RANDOM_TEMP));
+        precip = VAdd(VSet(basePrecip[month + 1]), VRanf(key0, key1, counter + 1, -RANDOM_PRECIP, RANDOM_PRECIP));
+        precip = VSelect(VCmpLt(precip, VSet(0.f)), VSet(0.f), precip);
+    }
+}
+
+// run the members SIMD_WIDTH at a time from the given state, returns the date they all end on
+// (members is rounded up to a whole number of SIMD groups)
+State RunSimdEnsemble(const State& start, int members, int maxThreads)
+{
+    members = (members + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+    AllocateEnsemble(start, members);
+
+    // everything that is the same for every member, once per month:
+    // the noise-free weather and the weeds' winter die-off
+    float* baseTemp = new float[EnsembleMonths + 1];
+    float* basePrecip = new float[EnsembleMonths + 1];
+    float* seasonal = new float[EnsembleMonths + 1];
+    State date = start;
+    for (int month = 0; month <= EnsembleMonths; month++) {
+        float ang = (30. * (float)date.Month + 15.) * (M_PI / 180.); // angle of earth around the sun
+        baseTemp[month] = AVG_TEMP - AMP_TEMP * cos(ang);
+        basePrecip[month] = AVG_PRECIP_PER_MONTH + AMP_PRECIP_PER_MONTH * sin(ang);
+        bool isWinter = (date.Month == 11 || date.Month == 0 || date.Month == 1);
+        seasonal[month] = isWinter ? (1.0 - WEED_DEATH_WINTER) : 1.0;
+        if (month < EnsembleMonths)
+            AdvanceMonth(date, date);
+    }
+
+    if (maxThreads > 0)
+        omp_set_num_threads(maxThreads);
+    else
+        omp_set_num_threads(omp_get_num_procs());
+
+#pragma omp parallel
+    {
+#pragma omp single nowait
+        EnsembleThreads = omp_get_num_threads();
+
+#pragma omp for schedule(dynamic)
+        for (int first = 0; first < members; first += SIMD_WIDTH) {
+            RunSimdGroup(start, first, baseTemp, basePrecip, seasonal);
+        }
+    }
+
+    delete[] baseTemp;
+    delete[] basePrecip;
+    delete[] seasonal;
+
+    return date;
+}
+
+#endif // SIMD_H
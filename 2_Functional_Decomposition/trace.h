@@ -0,0 +1,134 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// The barrier trace.
+// With --trace=file every WaitBarrier() call is recorded: when the thread
+// arrived, when it was let go, and which barrier it was. The events go into
+// buffers allocated per thread before the run, so recording is two stores and
+// no locking; nothing is formatted until the run is over. TraceWrite() then
+// turns them into Chrome trace-event JSON (chrome://tracing, Perfetto), one
+// row per thread named after the agents it runs, with a "work" span from
+// leaving one barrier to arriving at the next and a span for every wait.
+// The agent that arrives last at a barrier is the one holding up the month.
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+// events each thread can hold; later ones are counted and dropped:
+#ifndef TRACE_EVENTS_PER_THREAD
+#define TRACE_EVENTS_PER_THREAD (1 << 18)
+#endif
+
+// most threads the trace keeps a buffer for:
+#define MAX_TRACE_THREADS 64
+
+struct TraceEvent {
+    const char* Phase; // which barrier
+    long long Arrive; // nanoseconds since TraceOpen()
+    long long Leave;
+};
+
+// one thread's buffer, padded so the threads do not false-share:
+struct alignas(64) TraceThread {
+    TraceEvent* Events;
+    int NumEvents;
+    long long Dropped;
+    char Name[64]; // the agents this thread runs
+};
+
+bool Tracing = false;
+int NumTraceThreads = 0;
+TraceThread TraceThreads[MAX_TRACE_THREADS];
+std::chrono::steady_clock::time_point TraceStart;
+
+// allocate the buffers for threads 0 - numThreads-1 and start the clock
+void TraceOpen(int numThreads)
+{
+    NumTraceThreads = (numThreads < MAX_TRACE_THREADS) ? numThreads : MAX_TRACE_THREADS;
+    for (int t = 0; t < NumTraceThreads; t++) {
+        TraceThreads[t].Events = new TraceEvent[TRACE_EVENTS_PER_THREAD];
+        TraceThreads[t].NumEvents = 0;
+        TraceThreads[t].Dropped = 0;
+        TraceThreads[t].Name[0] = '\0';
+    }
+
+    TraceStart = std::chrono::steady_clock::now();
+    Tracing = true;
+}
+
+// add an agent's name to the calling thread's row
+void TraceName(int thread, const char* name)
+{
+    if (!Tracing || thread >= NumTraceThreads)
+        return;
+
+    char* row = TraceThreads[thread].Name;
+    size_t used = strlen(row);
+    snprintf(row + used, sizeof(TraceThreads[thread].Name) - used, "%s%s", (used > 0) ? "+" : "", name);
+}
+
+// called by WaitBarrier() with the times it measured anyway
+inline void TraceBarrier(int thread, const char* phase,
+    std::chrono::steady_clock::time_point arrive, std::chrono::steady_clock::time_point leave)
+{
+    if (thread >= NumTraceThreads)
+        return;
+
+    TraceThread* t = &TraceThreads[thread];
+    if (t->NumEvents >= TRACE_EVENTS_PER_THREAD) {
+        t->Dropped++;
+        return;
+    }
+
+    TraceEvent* e = &t->Events[t->NumEvents++];
+    e->Phase = phase;
+    e->Arrive = std::chrono::duration_cast<std::chrono::nanoseconds>(arrive - TraceStart).count();
+    e->Leave = std::chrono::duration_cast<std::chrono::nanoseconds>(leave - TraceStart).count();
+}
+
+// write the trace as Chrome trace-event JSON and free the buffers;
+// returns how many events did not fit
+long long TraceWrite(const char* path)
+{
+    Tracing = false;
+
+    long long dropped = 0;
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+        fprintf(stderr, "Cannot open %s for writing\n", path);
+
+    if (fp != NULL) {
+        fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        fprintf(fp, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"Functional Decomposition\"}}");
+        for (int t = 0; t < NumTraceThreads; t++) {
+            TraceThread* row = &TraceThreads[t];
+            fprintf(fp, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                t, (row->Name[0] != '\0') ? row->Name : "idle");
+            fprintf(fp, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":%d}}", t, t);
+
+            // timestamps are in microseconds:
+            long long previous = 0;
+            for (int i = 0; i < row->NumEvents; i++) {
+                TraceEvent* e = &row->Events[i];
+                fprintf(fp, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"cat\":\"work\",\"name\":\"%s\",\"ts\":%.3lf,\"dur\":%.3lf}",
+                    t, (row->Name[0] != '\0') ? row->Name : "work", previous / 1000., (e->Arrive - previous) / 1000.);
+                fprintf(fp, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"cat\":\"barrier\",\"name\":\"%s\",\"ts\":%.3lf,\"dur\":%.3lf}",
+                    t, e->Phase, e->Arrive / 1000., (e->Leave - e->Arrive) / 1000.);
+                previous = e->Leave;
+            }
+        }
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+    }
+
+    for (int t = 0; t < NumTraceThreads; t++) {
+        dropped += TraceThreads[t].Dropped;
+        delete[] TraceThreads[t].Events;
+        TraceThreads[t].Events = NULL;
+    }
+    NumTraceThreads = 0;
+    return dropped;
+}
+
+#endif // TRACE_H
@@ -0,0 +1,241 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+// The output writer.
+// The simulation threads hand fixed-size binary records to a background
+// writer thread through lock-free single-producer/single-consumer rings
+// (one ring per producing thread), so they never wait on formatting or on
+// I/O, and nothing has to be held in memory until the end of the run.
+// The writer turns the records into CSV, or into a compact columnar binary
+// file:
+//
+//   "GDWCOL1\0"                                   8-byte magic
+//   then blocks of up to WRITER_BLOCK records:
+//   uint32 count
+//   int32 Member[count], int32 Month[count], int32 Year[count],
+//   float Temp[count], float Precip[count], float Height[count],
+//   int32 Deer[count], float WeedDensity[count]
+//
+// Records from different rings are written in the order the writer drains
+// them, so rows from different members may interleave.
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+// records per ring (a power of two):
+#ifndef WRITER_RING_SIZE
+#define WRITER_RING_SIZE (1 << 14)
+#endif
+
+// records per block of the columnar binary format:
+#ifndef WRITER_BLOCK
+#define WRITER_BLOCK 4096
+#endif
+
+// most rings, i.e. most producing threads:
+#define MAX_WRITER_RINGS 64
+
+// one output row, as the producer hands it over
+struct OutputRecord {
+    int Member; // which ensemble member (0 for a single run)
+    int Month; // 1 - 12
+    int Year;
+    float Temp;
+    float Precip;
+    float Height;
+    int NumDeer;
+    float WeedDensity;
+};
+
+enum OutputFormat {
+    FORMAT_CSV,
+    FORMAT_BINARY
+};
+
+// a single-producer/single-consumer ring: Head only moves forward in the
+// producer, Tail only in the consumer, each on its own cache line
+struct RecordRing {
+    alignas(64) std::atomic<size_t> Head; // next slot the producer fills
+    alignas(64) std::atomic<size_t> Tail; // next slot the consumer empties
+    alignas(64) long long Stalls; // times the producer found the ring full
+    OutputRecord Slots[WRITER_RING_SIZE];
+};
+
+RecordRing* WriterRings = NULL;
+int NumWriterRings = 0;
+FILE* WriterFile = NULL;
+OutputFormat WriterFormat = FORMAT_CSV;
+bool WriterMemberColumn = false; // put the member number in the CSV rows
+std::atomic<bool> WriterStop;
+std::thread WriterThread;
+
+// the writer thread's buffers
+char* WriterText = NULL;
+size_t WriterTextUsed = 0;
+OutputRecord* WriterBlock = NULL;
+int WriterBlockUsed = 0;
+
+#define WRITER_TEXT_SIZE (1 << 16)
+
+static_assert(WRITER_BLOCK * sizeof(int32_t) <= WRITER_TEXT_SIZE, "a block's column is gathered in the text buffer");
+
+// called by the producer that owns the ring; waits only if the writer is a whole ring behind
+void WriterPush(int ring, const OutputRecord& record)
+{
+    RecordRing* r = &WriterRings[ring];
+    size_t head = r->Head.load(std::memory_order_relaxed);
+    if (head - r->Tail.load(std::memory_order_acquire) >= WRITER_RING_SIZE) {
+        r->Stalls++;
+        while (head - r->Tail.load(std::memory_order_acquire) >= WRITER_RING_SIZE)
+            std::this_thread::yield();
+    }
+
+    r->Slots[head & (WRITER_RING_SIZE - 1)] = record;
+    r->Head.store(head + 1, std::memory_order_release);
+}
+
+void WriteBlock()
+{
+    if (WriterBlockUsed == 0)
+        return;
+
+    uint32_t count = (uint32_t)WriterBlockUsed;
+    fwrite(&count, sizeof(count), 1, WriterFile);
+
+    // one column at a time, gathered through the text buffer:
+    for (int field = 0; field < (int)(sizeof(OutputRecord) / sizeof(int)); field++) {
+        int32_t* column = (int32_t*)WriterText;
+        for (int i = 0; i < WriterBlockUsed; i++)
+            memcpy(&column[i], (char*)&WriterBlock[i] + field * sizeof(int), sizeof(int32_t));
+        fwrite(column, sizeof(int32_t), WriterBlockUsed, WriterFile);
+    }
+
+    WriterBlockUsed = 0;
+}
+
+void WriteRecord(const OutputRecord& record)
+{
+    if (WriterFormat == FORMAT_BINARY) {
+        WriterBlock[WriterBlockUsed++] = record;
+        if (WriterBlockUsed == WRITER_BLOCK)
+            WriteBlock();
+        return;
+    }
+
+    if (WriterTextUsed > WRITER_TEXT_SIZE - 256) {
+        fwrite(WriterText, 1, WriterTextUsed, WriterFile);
+        WriterTextUsed = 0;
+    }
+
+    char* line = WriterText + WriterTextUsed;
+    if (WriterMemberColumn)
+        line += sprintf(line, "%d,", record.Member);
+    line += sprintf(line, "%d,%d,%.2f,%.2f,%.2f,%d,%.2f\n",
+        record.Month, record.Year, record.Temp, record.Precip, record.Height, record.NumDeer, record.WeedDensity);
+    WriterTextUsed = line - WriterText;
+}
+
+// take everything that is in the rings right now; returns how many records that was
+size_t DrainRings()
+{
+    size_t drained = 0;
+    for (int ring = 0; ring < NumWriterRings; ring++) {
+        RecordRing* r = &WriterRings[ring];
+        size_t tail = r->Tail.load(std::memory_order_relaxed);
+        size_t head = r->Head.load(std::memory_order_acquire);
+        for (size_t i = tail; i != head; i++)
+            WriteRecord(r->Slots[i & (WRITER_RING_SIZE - 1)]);
+        r->Tail.store(head, std::memory_order_release);
+        drained += head - tail;
+    }
+    return drained;
+}
+
+void WriterLoop()
+{
+    while (!WriterStop.load(std::memory_order_acquire)) {
+        if (DrainRings() == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    // the producers are done -- whatever is left is the end of the output:
+    DrainRings();
+}
+
+// start the writer thread with one ring for each of numRings producers;
+// path "-" is stdout. returns false if the file cannot be opened or there are more
+// than MAX_WRITER_RINGS rings (a ring is indexed by the producing thread's number)
+bool WriterOpen(const char* path, OutputFormat format, int numRings, bool memberColumn)
+{
+    if (numRings > MAX_WRITER_RINGS) {
+        fprintf(stderr, "The writer takes at most %d producing threads\n", MAX_WRITER_RINGS);
+        return false;
+    }
+
+    WriterFile = (strcmp(path, "-") == 0) ? stdout : fopen(path, (format == FORMAT_BINARY) ? "wb" : "w");
+    if (WriterFile == NULL) {
+        fprintf(stderr, "Cannot open %s for writing\n", path);
+        return false;
+    }
+
+    WriterFormat = format;
+    WriterMemberColumn = memberColumn;
+    NumWriterRings = numRings;
+    WriterRings = new RecordRing[NumWriterRings];
+    for (int ring = 0; ring < NumWriterRings; ring++) {
+        WriterRings[ring].Head.store(0);
+        WriterRings[ring].Tail.store(0);
+        WriterRings[ring].Stalls = 0;
+    }
+    WriterText = new char[WRITER_TEXT_SIZE];
+    WriterTextUsed = 0;
+    WriterBlock = new OutputRecord[WRITER_BLOCK];
+    WriterBlockUsed = 0;
+
+    if (format == FORMAT_BINARY) {
+        fwrite("GDWCOL1", 1, 8, WriterFile);
+    } else {
+        if (memberColumn)
+            fprintf(WriterFile, "Member,");
+        fprintf(WriterFile, "Month,Year,Temp,Precip,Height,Deer,WeedDensity\n");
+    }
+
+    WriterStop.store(false);
+    WriterThread = std::thread(WriterLoop);
+    return true;
+}
+
+// wait for the writer to empty the rings and finish the file;
+// returns how many times a producer had to wait for room
+long long WriterClose()
+{
+    WriterStop.store(true, std::memory_order_release);
+    WriterThread.join();
+
+    if (WriterFormat == FORMAT_BINARY)
+        WriteBlock();
+    else
+        fwrite(WriterText, 1, WriterTextUsed, WriterFile);
+
+    if (WriterFile == stdout)
+        fflush(stdout);
+    else
+        fclose(WriterFile);
+
+    long long stalls = 0;
+    for (int ring = 0; ring < NumWriterRings; ring++)
+        stalls += WriterRings[ring].Stalls;
+
+    delete[] WriterRings;
+    delete[] WriterText;
+    delete[] WriterBlock;
+    WriterRings = NULL;
+    NumWriterRings = 0;
+    return stalls;
+}
+
+#endif // WRITER_H
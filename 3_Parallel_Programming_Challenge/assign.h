@@ -0,0 +1,132 @@
+#ifndef ASSIGN_H
+#define ASSIGN_H
+
+// The nearest-capital kernels.
+// Each one finds, for the cities first - last-1, the capital with the smallest
+// squared distance (the square root does not change which one is nearest) and
+// writes its number into capital[]. The AVX2 and AVX-512 kernels take 8 or 16
+// cities at a time against one capital after another, keeping each lane's best
+// distance and capital number in registers (a vectorized argmin). Ties go to
+// the lower-numbered capital, as in the scalar loop.
+//
+// The vector kernels are compiled with target attributes, so the program itself
+// needs no -mavx flags; SelectAssignKernel() picks the widest one the CPU
+// running the program supports. With GEMM it returns the kernels of gemm.h instead.
+
+#include <immintrin.h>
+
+typedef void (*assignkernel)(int first, int last, const float* longitude, const float* latitude,
+    const float* capLongitude, const float* capLatitude, int numCapitals, int* capital);
+
+void AssignScalar(int first, int last, const float* longitude, const float* latitude,
+    const float* capLongitude, const float* capLatitude, int numCapitals, int* capital)
+{
+    for (int i = first; i < last; i++) {
+        int capitalnumber = 0;
+        float mindistance = 1.e+37;
+
+        for (int k = 0; k < numCapitals; k++) {
+            float dx = longitude[i] - capLongitude[k];
+            float dy = latitude[i] - capLatitude[k];
+            float dist = dx * dx + dy * dy;
+            if (dist < mindistance) {
+                mindistance = dist;
+                capitalnumber = k;
+            }
+        }
+
+        capital[i] = capitalnumber;
+    }
+}
+
+__attribute__((target("avx2,fma"))) void AssignAvx2(int first, int last, const float* longitude, const float* latitude,
+    const float* capLongitude, const float* capLatitude, int numCapitals, int* capital)
+{
+    int i = first;
+    for (; i + 8 <= last; i += 8) {
+        __m256 x = _mm256_loadu_ps(&longitude[i]);
+        __m256 y = _mm256_loadu_ps(&latitude[i]);
+        __m256 best = _mm256_set1_ps(1.e+37f);
+        __m256i bestk = _mm256_setzero_si256();
+
+        for (int k = 0; k < numCapitals; k++) {
+            __m256 dx = _mm256_sub_ps(x, _mm256_set1_ps(capLongitude[k]));
+            __m256 dy = _mm256_sub_ps(y, _mm256_set1_ps(capLatitude[k]));
+            __m256 dist = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+            __m256 closer = _mm256_cmp_ps(dist, best, _CMP_LT_OQ);
+            best = _mm256_blendv_ps(best, dist, closer);
+            bestk = _mm256_blendv_epi8(bestk, _mm256_set1_epi32(k), _mm256_castps_si256(closer));
+        }
+
+        _mm256_storeu_si256((__m256i*)&capital[i], bestk);
+    }
+
+    AssignScalar(i, last, longitude, latitude, capLongitude, capLatitude, numCapitals, capital);
+}
+
+__attribute__((target("avx512f"))) void AssignAvx512(int first, int last, const float* longitude, const float* latitude,
+    const float* capLongitude, const float* capLatitude, int numCapitals, int* capital)
+{
+    int i = first;
+    for (; i + 16 <= last; i += 16) {
+        __m512 x = _mm512_loadu_ps(&longitude[i]);
+        __m512 y = _mm512_loadu_ps(&latitude[i]);
+        __m512 best = _mm512_set1_ps(1.e+37f);
+        __m512i bestk = _mm512_setzero_si512();
+
+        for (int k = 0; k < numCapitals; k++) {
+            __m512 dx = _mm512_sub_ps(x, _mm512_set1_ps(capLongitude[k]));
+            __m512 dy = _mm512_sub_ps(y, _mm512_set1_ps(capLatitude[k]));
+            __m512 dist = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+            __mmask16 closer = _mm512_cmp_ps_mask(dist, best, _CMP_LT_OQ);
+            best = _mm512_mask_blend_ps(closer, best, dist);
+            bestk = _mm512_mask_blend_epi32(closer, bestk, _mm512_set1_epi32(k));
+        }
+
+        _mm512_storeu_si512((void*)&capital[i], bestk);
+    }
+
+    AssignScalar(i, last, longitude, latitude, capLongitude, capLatitude, numCapitals, capital);
+}
+
+// floating-point operations the selected kernel does per city and capital
+// (two subtractions, a multiply and a multiply-add, or two multiply-adds for GEMM):
+int AssignFlops = 5;
+
+// the widest kernel this CPU can run (or the scalar one if SCALAR is defined);
+// with GEMM, the GEMM-style kernels from gemm.h
+assignkernel SelectAssignKernel(const char** name)
+{
+#ifdef GEMM
+    AssignFlops = 4;
+#ifndef SCALAR
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        *name = "gemm-avx512";
+        return AssignGemmAvx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        *name = "gemm-avx2";
+        return AssignGemmAvx2;
+    }
+#endif
+    *name = "gemm-scalar";
+    return AssignGemmScalar;
+#endif
+
+#ifndef SCALAR
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        *name = "avx512";
+        return AssignAvx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        *name = "avx2";
+        return AssignAvx2;
+    }
+#endif
+    *name = "scalar";
+    return AssignScalar;
+}
+
+#endif // ASSIGN_H
@@ -1,8 +1,14 @@
 #!/bin/bash
 
 # Create output files with headers
-echo "NUMT,NUMCITIES,NUMCAPITALS,MegaCityCapitalsPerSecond" > results.csv
-echo "NUMT,NUMCITIES,NUMCAPITALS,MegaCityCapitalsPerSecond" > extra_results.csv
+HEADER="NUMT,NUMCITIES,NUMCAPITALS,MegaCityCapitalsPerSecond,Iterations,Seconds,P05,P50,P95,SkippedPercent,SeedSeconds,Inertia,MegaPointsPerSecond,LookupSeconds,GFlopsPerSecond,SortSeconds,CacheMisses"
+echo "$HEADER" > results.csv
+echo "$HEADER" > extra_results.csv
+echo "$HEADER" > critical_results.csv
+echo "$HEADER" > scalar_results.csv
+echo "$HEADER" > hamerly_results.csv
+echo "$HEADER" > kmeanspp_results.csv
+echo "$HEADER" > sphere_results.csv
 
 # Run tests for different combinations of threads and capitals
 for t in 1 2 4 6 8
@@ -15,4 +21,139 @@ do
     done
 done
 
-echo "Testing complete. Results saved to results.csv and extra_results.csv"
+# The same runs with the original critical-section summing, as the baseline
+for t in 1 2 4 6 8
+do
+    for n in 2 3 4 5 10 15 20 30 40 50
+        do
+        echo "Running the critical-section baseline with NUMT=$t, NUMCAPITALS=$n"
+        g++ main.cpp -DCRITICAL -DNUMT=$t -DNUMCAPITALS=$n -o main -fopenmp -lm
+        ./main > /dev/null 2>> critical_results.csv
+    done
+done
+
+# The scalar nearest-capital kernel, to compare with the AVX2/AVX-512 one picked at runtime
+for t in 1 2 4 6 8
+do
+    for n in 2 3 4 5 10 15 20 30 40 50
+        do
+        echo "Running the scalar kernel with NUMT=$t, NUMCAPITALS=$n"
+        g++ main.cpp -DSCALAR -DNUMT=$t -DNUMCAPITALS=$n -o main -fopenmp -lm
+        ./main > /dev/null 2>> scalar_results.csv
+    done
+done
+
+# Hamerly's bounds, to compare the time to solution with the brute-force search
+for t in 1 2 4 6 8
+do
+    for n in 2 3 4 5 10 15 20 30 40 50
+        do
+        echo "Running Hamerly's bounds with NUMT=$t, NUMCAPITALS=$n"
+        g++ main.cpp -DHAMERLY -DNUMT=$t -DNUMCAPITALS=$n -o main -fopenmp -lm
+        ./main > /dev/null 2>> hamerly_results.csv
+    done
+done
+
+# k-means|| seeding, to compare the iterations and the time to solution with the uniform seeds
+for t in 1 2 4 6 8
+do
+    for n in 2 3 4 5 10 15 20 30 40 50
+        do
+        echo "Running k-means|| seeding with NUMT=$t, NUMCAPITALS=$n"
+        g++ main.cpp -DKMEANSPP -DNUMT=$t -DNUMCAPITALS=$n -o main -fopenmp -lm
+        ./main > /dev/null 2>> kmeanspp_results.csv
+    done
+done
+
+# Great-circle distances, to compare the throughput with the planar runs
+for t in 1 2 4 6 8
+do
+    for n in 2 3 4 5 10 15 20 30 40 50
+        do
+        echo "Running great-circle distances with NUMT=$t, NUMCAPITALS=$n"
+        g++ main.cpp -DSPHERE -DNUMT=$t -DNUMCAPITALS=$n -o main -fopenmp -lm
+        ./main > /dev/null 2>> sphere_results.csv
+    done
+done
+
+# Every K from 2 to 50 in one run per thread count, each warm-started from the one before
+echo "NUMT,NUMCITIES,NUMCAPITALS,MegaCityCapitalsPerSecond,Iterations,Seconds,Inertia,Silhouette,SilhouetteSeconds" > sweep_results.csv
+for t in 1 2 4 6 8
+do
+    echo "Running the K sweep with NUMT=$t"
+    g++ main.cpp -DSWEEP -DNUMT=$t -DNUMCAPITALS=50 -o main -fopenmp -lm
+    ./main > /dev/null 2>> sweep_results.csv
+done
+
+# Best of 16 restarts, a thread per restart, to see the restarts/sec scale with the threads
+echo "NUMT,NUMCITIES,NUMCAPITALS,Restarts,RestartsPerSecond,Seconds,BestInertia,FirstInertia,MeanIterations" > restarts_results.csv
+for t in 1 2 4 6 8
+do
+    for n in 5 10 20 50
+        do
+        echo "Running 16 restarts with NUMT=$t, NUMCAPITALS=$n"
+        g++ main.cpp -DRESTARTS=16 -DNUMT=$t -DNUMCAPITALS=$n -o main -fopenmp -lm
+        ./main > /dev/null 2>> restarts_results.csv
+    done
+done
+
+# A large point set from a file instead of the compiled-in cities: 10^7 random
+# points over the continental US, parsed on the first run and memory-mapped after that
+echo "$HEADER" > large_results.csv
+awk 'BEGIN { srand(1); print "Longitude,Latitude"; for (i = 0; i < 10000000; i++) printf "%.4f,%.4f\n", 70. + 55. * rand(), 25. + 24. * rand() }' > points.csv
+for t in 1 2 4 6 8
+do
+    echo "Running 10^7 points with NUMT=$t"
+    g++ main.cpp -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> large_results.csv
+    g++ main.cpp -DHAMERLY -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> large_results.csv
+    g++ main.cpp -DKMEANSPP -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> large_results.csv
+    g++ main.cpp -DKDTREE -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> large_results.csv
+done
+
+# Mini-batch k-means streaming the same points, to compare the points/sec and the
+# inertia with the full-batch runs in large_results.csv
+echo "$HEADER" > minibatch_results.csv
+for t in 1 2 4 6 8
+do
+    echo "Running mini-batch k-means over 10^7 points with NUMT=$t"
+    g++ main.cpp -DMINIBATCH -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> minibatch_results.csv
+    g++ main.cpp -DMINIBATCH -DKMEANSPP -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> minibatch_results.csv
+done
+
+# The 10^7 points as they are and sorted into Z order, to compare the iterations'
+# throughput and cache misses before and after
+echo "$HEADER" > morton_results.csv
+for t in 1 2 4 6 8
+do
+    echo "Running 10^7 points in file and Z order with NUMT=$t"
+    g++ main.cpp -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> morton_results.csv
+    g++ main.cpp -DMORTON -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> morton_results.csv
+    g++ main.cpp -DHAMERLY -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> morton_results.csv
+    g++ main.cpp -DHAMERLY -DMORTON -DNUMT=$t -DNUMCAPITALS=10 -o main -fopenmp -lm
+    ./main points.csv > /dev/null 2>> morton_results.csv
+done
+
+# The direct and the GEMM-form kernels over growing numbers of capitals, on the
+# first 10^5 of the points, and the first K at which the GEMM form is faster
+echo "$HEADER" > gemm_results.csv
+head -n 100001 points.csv > gemm_points.csv
+for n in 2 5 10 20 50 100 200 400
+do
+    echo "Running the direct and GEMM kernels with NUMT=1, NUMCAPITALS=$n"
+    g++ main.cpp -DNUMT=1 -DNUMCAPITALS=$n -o main -fopenmp -lm
+    ./main gemm_points.csv > /dev/null 2>> gemm_results.csv
+    g++ main.cpp -DGEMM -DNUMT=1 -DNUMCAPITALS=$n -o main -fopenmp -lm
+    ./main gemm_points.csv > /dev/null 2>> gemm_results.csv
+done
+awk -F, 'NR > 1 && NR % 2 == 0 { direct = $4 } NR > 1 && NR % 2 == 1 && $4 > direct && !found { print "GEMM is faster from NUMCAPITALS =" $3; found = 1 }' gemm_results.csv
+
+echo "Testing complete. Results saved to results.csv, extra_results.csv, critical_results.csv, scalar_results.csv, hamerly_results.csv, kmeanspp_results.csv, sphere_results.csv, sweep_results.csv, restarts_results.csv, large_results.csv, minibatch_results.csv, morton_results.csv and gemm_results.csv"
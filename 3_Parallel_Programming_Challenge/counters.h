@@ -0,0 +1,72 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+// The cache-miss counter.
+// Every thread of the team opens its own hardware counter of last-level cache
+// misses with perf_event_open(2), counting only while that thread runs in user
+// space, and CounterRead() adds them all up. The OpenMP threads live as long as
+// the program, so the counters follow the same threads through every parallel
+// region; the difference between two reads is the misses in between.
+//
+// Virtual machines and containers often have no hardware counters, or
+// /proc/sys/kernel/perf_event_paranoid forbids them; then CounterRead() returns
+// -1 and the CSV shows -1.
+//
+// Include this after NUMT.
+
+#include <linux/perf_event.h>
+#include <omp.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// each thread's counter, or -1:
+int CounterFds[NUMT];
+
+// open a counter on every thread of the team; false if any could not be opened
+bool CounterOpen()
+{
+    for (int t = 0; t < NUMT; t++)
+        CounterFds[t] = -1;
+
+    int failed = 0;
+#pragma omp parallel default(none) shared(CounterFds) reduction(+ : failed)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        CounterFds[omp_get_thread_num()] = fd;
+        if (fd < 0)
+            failed++;
+    }
+    return failed == 0;
+}
+
+// the misses counted so far by all the threads, or -1 if there are no counters
+long long CounterRead()
+{
+    long long total = 0;
+    for (int t = 0; t < NUMT; t++) {
+        long long count;
+        if (CounterFds[t] < 0 || read(CounterFds[t], &count, sizeof(count)) != (ssize_t)sizeof(count))
+            return -1;
+        total += count;
+    }
+    return total;
+}
+
+void CounterClose()
+{
+    for (int t = 0; t < NUMT; t++) {
+        if (CounterFds[t] >= 0)
+            close(CounterFds[t]);
+        CounterFds[t] = -1;
+    }
+}
+
+#endif // COUNTERS_H
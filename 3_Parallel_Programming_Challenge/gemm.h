@@ -0,0 +1,202 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+// The GEMM-style nearest-capital kernels.
+// The squared distance |p - c|² = |p|² - 2 p·c + |c|², and |p|² is the same
+// for every capital, so the nearest capital is the one with the smallest
+//
+//   |c|² - 2 p·c  =  lng * (-2 c.lng) + (lat * (-2 c.lat) + |c|²)
+//
+// two multiply-adds per city and capital once -2c and |c|² are known, instead
+// of two subtractions, a multiply and a multiply-add. That is a small matrix
+// multiply of the cities by the capitals with the argmin fused onto it, and it
+// is blocked like one: the -2c and |c|² of up to GEMM_KBLOCK capitals at a time
+// are prepared into arrays that stay in L1, and each block of cities is held in
+// registers as a tile of several vectors (GEMM_TILE of them with AVX-512, half
+// as many with AVX2) while the capitals stream past, so every broadcast capital
+// is used for the whole tile. The running best of each city is kept between
+// capital blocks.
+//
+// |c|² - 2 p·c subtracts two large numbers to get a small one, so the cities
+// and capitals are first moved to be relative to capital 0, which keeps them
+// small; even so the rounding differs from the direct kernels', and a city
+// almost exactly between two capitals can go to the other one.
+//
+// Include this after ASSIGNBLOCK.
+
+#include <immintrin.h>
+
+// capitals prepared at a time:
+#ifndef GEMM_KBLOCK
+#define GEMM_KBLOCK 256
+#endif
+
+// vectors of cities in an AVX-512 tile (the AVX2 tile is half this):
+#ifndef GEMM_TILE
+#define GEMM_TILE 4
+#endif
+
+// -2c and |c|² for capitals kb - kb+kn-1, relative to (refLng, refLat)
+inline void GemmPrepare(const float* capLongitude, const float* capLatitude, float refLng, float refLat, int kb, int kn, float* a, float* b, float* c)
+{
+    for (int k = 0; k < kn; k++) {
+        float lng = capLongitude[kb + k] - refLng;
+        float lat = capLatitude[kb + k] - refLat;
+        a[k] = -2.f * lng;
+        b[k] = -2.f * lat;
+        c[k] = lng * lng + lat * lat;
+    }
+}
+
+// cities first - last-1 against the prepared block of capitals, scalar
+inline void GemmScalarBlock(int first, int last, const float* longitude, const float* latitude, float refLng, float refLat,
+    const float* a, const float* b, const float* c, int kb, int kn, float* bestDist, int* capital)
+{
+    for (int i = first; i < last; i++) {
+        float x = longitude[i] - refLng;
+        float y = latitude[i] - refLat;
+        float best = (kb == 0) ? 1.e+37f : bestDist[i - first];
+        int bestk = (kb == 0) ? 0 : capital[i];
+        for (int k = 0; k < kn; k++) {
+            float dist = x * a[k] + (y * b[k] + c[k]);
+            if (dist < best) {
+                best = dist;
+                bestk = kb + k;
+            }
+        }
+        bestDist[i - first] = best;
+        capital[i] = bestk;
+    }
+}
+
+void AssignGemmScalar(int first, int last, const float* longitude, const float* latitude,
+    const float* capLongitude, const float* capLatitude, int numCapitals, int* capital)
+{
+    alignas(64) float a[GEMM_KBLOCK], b[GEMM_KBLOCK], c[GEMM_KBLOCK];
+    float bestDist[ASSIGNBLOCK];
+    float refLng = capLongitude[0], refLat = capLatitude[0];
+    for (int chunk = first; chunk < last; chunk += ASSIGNBLOCK) {
+        int chunkLast = (chunk + ASSIGNBLOCK < last) ? chunk + ASSIGNBLOCK : last;
+        for (int kb = 0; kb < numCapitals; kb += GEMM_KBLOCK) {
+            int kn = (kb + GEMM_KBLOCK < numCapitals) ? GEMM_KBLOCK : numCapitals - kb;
+            GemmPrepare(capLongitude, capLatitude, refLng, refLat, kb, kn, a, b, c);
+            GemmScalarBlock(chunk, chunkLast, longitude, latitude, refLng, refLat, a, b, c, kb, kn, bestDist, capital);
+        }
+    }
+}
+
+// V vectors of 8 cities starting at i against the prepared block of capitals
+template <int V>
+__attribute__((target("avx2,fma"))) inline void GemmTileAvx2(int i, int chunk, const float* longitude, const float* latitude, __m256 refLng, __m256 refLat,
+    const float* a, const float* b, const float* c, int kb, int kn, float* bestDist, int* capital)
+{
+    __m256 x[V], y[V], best[V];
+    __m256i bestk[V];
+    for (int v = 0; v < V; v++) {
+        x[v] = _mm256_sub_ps(_mm256_loadu_ps(&longitude[i + 8 * v]), refLng);
+        y[v] = _mm256_sub_ps(_mm256_loadu_ps(&latitude[i + 8 * v]), refLat);
+        best[v] = (kb == 0) ? _mm256_set1_ps(1.e+37f) : _mm256_loadu_ps(&bestDist[i - chunk + 8 * v]);
+        bestk[v] = (kb == 0) ? _mm256_setzero_si256() : _mm256_loadu_si256((const __m256i*)&capital[i + 8 * v]);
+    }
+
+    for (int k = 0; k < kn; k++) {
+        __m256 ak = _mm256_set1_ps(a[k]);
+        __m256 bk = _mm256_set1_ps(b[k]);
+        __m256 ck = _mm256_set1_ps(c[k]);
+        __m256i kk = _mm256_set1_epi32(kb + k);
+        for (int v = 0; v < V; v++) {
+            __m256 dist = _mm256_fmadd_ps(x[v], ak, _mm256_fmadd_ps(y[v], bk, ck));
+            __m256 closer = _mm256_cmp_ps(dist, best[v], _CMP_LT_OQ);
+            best[v] = _mm256_blendv_ps(best[v], dist, closer);
+            bestk[v] = _mm256_blendv_epi8(bestk[v], kk, _mm256_castps_si256(closer));
+        }
+    }
+
+    for (int v = 0; v < V; v++) {
+        _mm256_storeu_ps(&bestDist[i - chunk + 8 * v], best[v]);
+        _mm256_storeu_si256((__m256i*)&capital[i + 8 * v], bestk[v]);
+    }
+}
+
+__attribute__((target("avx2,fma"))) void AssignGemmAvx2(int first, int last, const float* longitude, const float* latitude,
+    const float* capLongitude, const float* capLatitude, int numCapitals, int* capital)
+{
+    alignas(64) float a[GEMM_KBLOCK], b[GEMM_KBLOCK], c[GEMM_KBLOCK];
+    alignas(64) float bestDist[ASSIGNBLOCK];
+    float refLng = capLongitude[0], refLat = capLatitude[0];
+    __m256 vRefLng = _mm256_set1_ps(refLng), vRefLat = _mm256_set1_ps(refLat);
+    const int tile = 8 * (GEMM_TILE / 2);
+    for (int chunk = first; chunk < last; chunk += ASSIGNBLOCK) {
+        int chunkLast = (chunk + ASSIGNBLOCK < last) ? chunk + ASSIGNBLOCK : last;
+        for (int kb = 0; kb < numCapitals; kb += GEMM_KBLOCK) {
+            int kn = (kb + GEMM_KBLOCK < numCapitals) ? GEMM_KBLOCK : numCapitals - kb;
+            GemmPrepare(capLongitude, capLatitude, refLng, refLat, kb, kn, a, b, c);
+
+            int i = chunk;
+            for (; i + tile <= chunkLast; i += tile)
+                GemmTileAvx2<GEMM_TILE / 2>(i, chunk, longitude, latitude, vRefLng, vRefLat, a, b, c, kb, kn, bestDist, capital);
+            for (; i + 8 <= chunkLast; i += 8)
+                GemmTileAvx2<1>(i, chunk, longitude, latitude, vRefLng, vRefLat, a, b, c, kb, kn, bestDist, capital);
+            GemmScalarBlock(i, chunkLast, longitude, latitude, refLng, refLat, a, b, c, kb, kn, bestDist + (i - chunk), capital);
+        }
+    }
+}
+
+// V vectors of 16 cities starting at i against the prepared block of capitals
+template <int V>
+__attribute__((target("avx512f"))) inline void GemmTileAvx512(int i, int chunk, const float* longitude, const float* latitude, __m512 refLng, __m512 refLat,
+    const float* a, const float* b, const float* c, int kb, int kn, float* bestDist, int* capital)
+{
+    __m512 x[V], y[V], best[V];
+    __m512i bestk[V];
+    for (int v = 0; v < V; v++) {
+        x[v] = _mm512_sub_ps(_mm512_loadu_ps(&longitude[i + 16 * v]), refLng);
+        y[v] = _mm512_sub_ps(_mm512_loadu_ps(&latitude[i + 16 * v]), refLat);
+        best[v] = (kb == 0) ? _mm512_set1_ps(1.e+37f) : _mm512_loadu_ps(&bestDist[i - chunk + 16 * v]);
+        bestk[v] = (kb == 0) ? _mm512_setzero_si512() : _mm512_loadu_si512((const void*)&capital[i + 16 * v]);
+    }
+
+    for (int k = 0; k < kn; k++) {
+        __m512 ak = _mm512_set1_ps(a[k]);
+        __m512 bk = _mm512_set1_ps(b[k]);
+        __m512 ck = _mm512_set1_ps(c[k]);
+        __m512i kk = _mm512_set1_epi32(kb + k);
+        for (int v = 0; v < V; v++) {
+            __m512 dist = _mm512_fmadd_ps(x[v], ak, _mm512_fmadd_ps(y[v], bk, ck));
+            __mmask16 closer = _mm512_cmp_ps_mask(dist, best[v], _CMP_LT_OQ);
+            best[v] = _mm512_mask_blend_ps(closer, best[v], dist);
+            bestk[v] = _mm512_mask_blend_epi32(closer, bestk[v], kk);
+        }
+    }
+
+    for (int v = 0; v < V; v++) {
+        _mm512_storeu_ps(&bestDist[i - chunk + 16 * v], best[v]);
+        _mm512_storeu_si512((void*)&capital[i + 16 * v], bestk[v]);
+    }
+}
+
+__attribute__((target("avx512f"))) void AssignGemmAvx512(int first, int last, const float* longitude, const float* latitude,
+    const float* capLongitude, const float* capLatitude, int numCapitals, int* capital)
+{
+    alignas(64) float a[GEMM_KBLOCK], b[GEMM_KBLOCK], c[GEMM_KBLOCK];
+    alignas(64) float bestDist[ASSIGNBLOCK];
+    float refLng = capLongitude[0], refLat = capLatitude[0];
+    __m512 vRefLng = _mm512_set1_ps(refLng), vRefLat = _mm512_set1_ps(refLat);
+    const int tile = 16 * GEMM_TILE;
+    for (int chunk = first; chunk < last; chunk += ASSIGNBLOCK) {
+        int chunkLast = (chunk + ASSIGNBLOCK < last) ? chunk + ASSIGNBLOCK : last;
+        for (int kb = 0; kb < numCapitals; kb += GEMM_KBLOCK) {
+            int kn = (kb + GEMM_KBLOCK < numCapitals) ? GEMM_KBLOCK : numCapitals - kb;
+            GemmPrepare(capLongitude, capLatitude, refLng, refLat, kb, kn, a, b, c);
+
+            int i = chunk;
+            for (; i + tile <= chunkLast; i += tile)
+                GemmTileAvx512<GEMM_TILE>(i, chunk, longitude, latitude, vRefLng, vRefLat, a, b, c, kb, kn, bestDist, capital);
+            for (; i + 16 <= chunkLast; i += 16)
+                GemmTileAvx512<1>(i, chunk, longitude, latitude, vRefLng, vRefLat, a, b, c, kb, kn, bestDist, capital);
+            GemmScalarBlock(i, chunkLast, longitude, latitude, refLng, refLat, a, b, c, kb, kn, bestDist + (i - chunk), capital);
+        }
+    }
+}
+
+#endif // GEMM_H
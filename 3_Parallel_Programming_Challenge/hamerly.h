@@ -0,0 +1,130 @@
+#ifndef HAMERLY_H
+#define HAMERLY_H
+
+// Hamerly's bounds.
+// Every city keeps an upper bound on the distance to its own capital and a
+// lower bound on the distance to every other capital. When a capital moves,
+// the bounds are loosened by how far it moved instead of being recomputed.
+// A city cannot have changed capital if its upper bound is no more than
+// either its lower bound or half the distance from its capital to the nearest
+// other capital, so its distances are skipped. Otherwise the upper bound is
+// tightened with one distance, and only if that is not enough are all the
+// capitals searched. After the first few iterations most cities are skipped.
+//
+// The bounds need true (not squared) distances for the triangle inequality.
+// One lower bound per city suits the small K used here; Elkan's K lower bounds
+// per city pay off only for much larger K.
+//
+// Include this after the City* arrays and CapitalLongitude[]/CapitalLatitude[].
+
+#include <math.h>
+
+float* UpperBound; // distance to its own capital is at most this
+float* LowerBound; // distance to any other capital is at least this
+
+// half the distance from each capital to the nearest other capital:
+float CapitalHalfGap[NUMCAPITALS];
+
+// how far each capital moved in the last update, and the largest and second
+// largest moves (the lower bound of a city whose capital moved the most only
+// needs to be loosened by the second largest):
+float CapitalShift[NUMCAPITALS];
+float MaxShift, SecondShift;
+int MaxShiftCapital;
+
+void HamerlyInit(int numCities)
+{
+    UpperBound = new float[numCities];
+    LowerBound = new float[numCities];
+    for (int i = 0; i < numCities; i++) {
+        UpperBound[i] = 1.e+37;
+        LowerBound[i] = 0.;
+    }
+    for (int k = 0; k < NUMCAPITALS; k++)
+        CapitalShift[k] = 0.;
+}
+
+void HamerlyFree()
+{
+    delete[] UpperBound;
+    delete[] LowerBound;
+}
+
+// once per iteration, after the capitals have been moved and CapitalShift[] set
+void HamerlyPrepare()
+{
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        float nearest = 1.e+37;
+        for (int j = 0; j < NUMCAPITALS; j++) {
+            if (j == k)
+                continue;
+            float dx = CapitalLongitude[k] - CapitalLongitude[j];
+            float dy = CapitalLatitude[k] - CapitalLatitude[j];
+            float d = sqrtf(dx * dx + dy * dy);
+            if (d < nearest)
+                nearest = d;
+        }
+        CapitalHalfGap[k] = 0.5f * nearest;
+    }
+
+    MaxShift = SecondShift = 0.;
+    MaxShiftCapital = -1;
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        if (CapitalShift[k] > MaxShift) {
+            SecondShift = MaxShift;
+            MaxShift = CapitalShift[k];
+            MaxShiftCapital = k;
+        } else if (CapitalShift[k] > SecondShift) {
+            SecondShift = CapitalShift[k];
+        }
+    }
+}
+
+// bring city i up to date with the capitals' moves and reassign it if it may have
+// changed capital; returns how many distances that took
+inline int HamerlyAssign(int i)
+{
+    int a = CityCapital[i];
+    int computed = 0;
+
+    if (a >= 0) {
+        UpperBound[i] += CapitalShift[a];
+        LowerBound[i] -= (a == MaxShiftCapital) ? SecondShift : MaxShift;
+
+        float bound = (CapitalHalfGap[a] > LowerBound[i]) ? CapitalHalfGap[a] : LowerBound[i];
+        if (UpperBound[i] <= bound)
+            return 0;
+
+        // tighten the upper bound and try again:
+        float dx = CityLongitude[i] - CapitalLongitude[a];
+        float dy = CityLatitude[i] - CapitalLatitude[a];
+        UpperBound[i] = sqrtf(dx * dx + dy * dy);
+        computed++;
+        if (UpperBound[i] <= bound)
+            return computed;
+    }
+
+    // search every capital for the nearest and the second nearest:
+    int capitalnumber = 0;
+    float mindistance = 1.e+37, secondDistance = 1.e+37;
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        float dx = CityLongitude[i] - CapitalLongitude[k];
+        float dy = CityLatitude[i] - CapitalLatitude[k];
+        float dist = dx * dx + dy * dy;
+        if (dist < mindistance) {
+            secondDistance = mindistance;
+            mindistance = dist;
+            capitalnumber = k;
+        } else if (dist < secondDistance) {
+            secondDistance = dist;
+        }
+    }
+    computed += NUMCAPITALS;
+
+    CityCapital[i] = capitalnumber;
+    UpperBound[i] = sqrtf(mindistance);
+    LowerBound[i] = sqrtf(secondDistance);
+    return computed;
+}
+
+#endif // HAMERLY_H
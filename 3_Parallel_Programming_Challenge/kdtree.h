@@ -0,0 +1,165 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+// An implicit k-d tree over longitude-latitude points.
+// The tree has no nodes or pointers: the points are reordered so that every
+// subtree is a contiguous range of the arrays, with its splitting point in the
+// middle, the points on the low side before it and the points on the high side
+// after it. Levels split on longitude and latitude in turn. A range of at most
+// KDTREE_LEAF points is a leaf and is simply scanned, so the last few levels
+// of a search read consecutive floats.
+//
+// KdBuild() partitions the two halves of every range in parallel (OpenMP
+// tasks); KdNearest() answers one query in O(log N) on average, and
+// KdNearestBatch() answers many in parallel. The tree keeps its own copy of the
+// coordinates, so it can index any point set, not just the cities.
+
+#include <algorithm>
+#include <omp.h>
+
+// most points in a range that is scanned instead of split:
+#ifndef KDTREE_LEAF
+#define KDTREE_LEAF 16
+#endif
+
+// ranges smaller than this are built by one task:
+#define KDTREE_TASK 16384
+
+struct kdtree {
+    int Count;
+    float* Longitude; // the points in tree order
+    float* Latitude;
+    int* Index; // each one's number in the original arrays
+};
+
+// a point while the tree is built, its coordinates next to each other so that
+// partitioning moves 12 bytes without following an index into the arrays:
+struct kdpoint {
+    float Longitude;
+    float Latitude;
+    int Index;
+};
+
+// put the splitting point of points[lo] - points[hi-1] in the middle, and recurse
+void KdPartition(struct kdpoint* points, int lo, int hi, int depth)
+{
+    if (hi - lo <= KDTREE_LEAF)
+        return;
+
+    int mid = (lo + hi) / 2;
+    if (depth % 2 == 0) {
+        std::nth_element(points + lo, points + mid, points + hi, [](const kdpoint& a, const kdpoint& b) {
+            return a.Longitude < b.Longitude || (a.Longitude == b.Longitude && a.Index < b.Index);
+        });
+    } else {
+        std::nth_element(points + lo, points + mid, points + hi, [](const kdpoint& a, const kdpoint& b) {
+            return a.Latitude < b.Latitude || (a.Latitude == b.Latitude && a.Index < b.Index);
+        });
+    }
+
+    if (hi - lo > KDTREE_TASK) {
+#pragma omp task default(none) firstprivate(points, lo, mid, depth)
+        KdPartition(points, lo, mid, depth + 1);
+#pragma omp task default(none) firstprivate(points, mid, hi, depth)
+        KdPartition(points, mid + 1, hi, depth + 1);
+    } else {
+        KdPartition(points, lo, mid, depth + 1);
+        KdPartition(points, mid + 1, hi, depth + 1);
+    }
+}
+
+// build the tree over n points
+void KdBuild(struct kdtree* tree, const float* longitude, const float* latitude, int n)
+{
+    tree->Count = n;
+    tree->Longitude = new float[n];
+    tree->Latitude = new float[n];
+    tree->Index = new int[n];
+
+    struct kdpoint* points = new struct kdpoint[n];
+#pragma omp parallel for default(none) shared(points, longitude, latitude, n)
+    for (int i = 0; i < n; i++)
+        points[i] = { longitude[i], latitude[i], i };
+
+#pragma omp parallel default(none) shared(points, n)
+#pragma omp single
+    KdPartition(points, 0, n, 0);
+
+    // split them back into arrays, in tree order:
+    float* treeLongitude = tree->Longitude;
+    float* treeLatitude = tree->Latitude;
+    int* treeIndex = tree->Index;
+#pragma omp parallel for default(none) shared(points, treeLongitude, treeLatitude, treeIndex, n)
+    for (int i = 0; i < n; i++) {
+        treeLongitude[i] = points[i].Longitude;
+        treeLatitude[i] = points[i].Latitude;
+        treeIndex[i] = points[i].Index;
+    }
+    delete[] points;
+}
+
+void KdFree(struct kdtree* tree)
+{
+    delete[] tree->Longitude;
+    delete[] tree->Latitude;
+    delete[] tree->Index;
+    tree->Count = 0;
+}
+
+// search the range lo - hi-1 for anything nearer than *bestDist
+// (ties go to the lower original index, as in a scan of the original arrays)
+void KdSearch(const struct kdtree* tree, float x, float y, int lo, int hi, int depth, float* bestDist, int* best)
+{
+    if (hi - lo <= KDTREE_LEAF) {
+        for (int i = lo; i < hi; i++) {
+            float dx = tree->Longitude[i] - x;
+            float dy = tree->Latitude[i] - y;
+            float dist = dx * dx + dy * dy;
+            if (dist < *bestDist || (dist == *bestDist && tree->Index[i] < *best)) {
+                *bestDist = dist;
+                *best = tree->Index[i];
+            }
+        }
+        return;
+    }
+
+    int mid = (lo + hi) / 2;
+    float dx = tree->Longitude[mid] - x;
+    float dy = tree->Latitude[mid] - y;
+    float dist = dx * dx + dy * dy;
+    if (dist < *bestDist || (dist == *bestDist && tree->Index[mid] < *best)) {
+        *bestDist = dist;
+        *best = tree->Index[mid];
+    }
+
+    // the query's side first, then the other side only if it could hold something nearer:
+    float diff = (depth % 2 == 0) ? x - tree->Longitude[mid] : y - tree->Latitude[mid];
+    if (diff < 0.) {
+        KdSearch(tree, x, y, lo, mid, depth + 1, bestDist, best);
+        if (diff * diff <= *bestDist)
+            KdSearch(tree, x, y, mid + 1, hi, depth + 1, bestDist, best);
+    } else {
+        KdSearch(tree, x, y, mid + 1, hi, depth + 1, bestDist, best);
+        if (diff * diff <= *bestDist)
+            KdSearch(tree, x, y, lo, mid, depth + 1, bestDist, best);
+    }
+}
+
+// the original index of the point nearest (x,y), or -1 if the tree is empty
+int KdNearest(const struct kdtree* tree, float x, float y)
+{
+    float bestDist = 1.e+37;
+    int best = -1;
+    KdSearch(tree, x, y, 0, tree->Count, 0, &bestDist, &best);
+    return best;
+}
+
+// the nearest point to each of n queries, in parallel
+void KdNearestBatch(const struct kdtree* tree, const float* x, const float* y, int n, int* nearest)
+{
+#pragma omp parallel for default(none) shared(tree, x, y, n, nearest) schedule(dynamic, 64)
+    for (int q = 0; q < n; q++)
+        nearest[q] = KdNearest(tree, x[q], y[q]);
+}
+
+#endif // KDTREE_H
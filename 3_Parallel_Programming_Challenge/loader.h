@@ -0,0 +1,300 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+// The point loader.
+// Without a file the cities compiled in from UsCities.data are used. Given a
+// CSV file of longitude,latitude lines (a header line and any further columns
+// are skipped), the loader parses it once and writes a binary point file next
+// to it (points.csv -> points.csv.bin); later runs find the binary file and
+// memory-map it, so startup neither copies nor parses anything. A file ending
+// in .bin is mapped directly.
+//
+// The binary file records the size and modification time (to the nanosecond)
+// of the CSV it came from, and is converted again if the CSV's differ: a
+// newer-than test on seconds would miss a CSV rewritten in the second its
+// binary file was written.
+//
+// The binary point file is structure-of-arrays, ready to be used in place:
+//
+//   char magic[8] = "KMPTS01"   uint64 count   uint64 stride
+//   uint64 csvSize   int64 csvSeconds   int64 csvNanoseconds   (padded to 64 bytes)
+//   float longitude[stride]     float latitude[stride]
+//
+// stride is count rounded up to a multiple of 16, so both arrays start on a
+// 64-byte boundary.
+//
+// Include this after NUMCAPITALS, ASSIGNBLOCK, struct city, Cities[] and the City* pointers.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define POINTFILE_MAGIC "KMPTS01"
+#define POINTFILE_HEADER 64
+
+// the most points a full batch can number: the block loops step an int by ASSIGNBLOCK past the last point
+#define MAX_POINTS (INT_MAX - ASSIGNBLOCK)
+
+struct pointfileheader {
+    char magic[8];
+    uint64_t count;
+    uint64_t stride;
+    uint64_t csvSize; // the CSV converted, or 0s
+    int64_t csvSeconds;
+    int64_t csvNanoseconds;
+};
+
+// where the coordinates came from, so they can be released the same way:
+void* MappedPoints = NULL;
+size_t MappedBytes = 0;
+bool NamedCities = false; // true if the points are Cities[], with their names
+int* PointOrder = NULL; // each point's original number, if the points have been reordered
+int* PointPosition = NULL; // and where each original point is now
+
+size_t PointStride(size_t count)
+{
+    return (count + 15) / 16 * 16;
+}
+
+// map a binary point file; returns false (after saying why) if it is not one, or
+// has more points than a full batch can number
+bool MapPointFile(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+
+    struct stat st;
+    struct pointfileheader header;
+    if (fstat(fd, &st) != 0 || read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)
+        || memcmp(header.magic, POINTFILE_MAGIC, 8) != 0 || header.stride < header.count
+        || (size_t)st.st_size < POINTFILE_HEADER + 2 * header.stride * sizeof(float)) {
+        fprintf(stderr, "%s is not a point file\n", path);
+        close(fd);
+        return false;
+    }
+    // (the points are numbered with ints; the mini-batch stream has no such limit)
+    if (header.count > MAX_POINTS) {
+        fprintf(stderr, "%s has %llu points, more than the %d this program can number\n", path, (unsigned long long)header.count, MAX_POINTS);
+        close(fd);
+        return false;
+    }
+
+    MappedBytes = (size_t)st.st_size;
+    MappedPoints = mmap(NULL, MappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (MappedPoints == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %s\n", path);
+        MappedPoints = NULL;
+        return false;
+    }
+    madvise(MappedPoints, MappedBytes, MADV_SEQUENTIAL);
+
+    NumCities = (int)header.count;
+    CityLongitude = (float*)((char*)MappedPoints + POINTFILE_HEADER);
+    CityLatitude = CityLongitude + header.stride;
+    return true;
+}
+
+// the point on a CSV line, or false for a header or a blank line
+bool ParseCsvLine(const char* line, float* lng, float* lat)
+{
+    char* end;
+    *lng = strtof(line, &end);
+    if (end == line || *end != ',')
+        return false;
+    const char* next = end + 1;
+    *lat = strtof(next, &end);
+    return end != next;
+}
+
+// parse a CSV file of longitude,latitude lines and write it out as a binary point file
+// (two passes over the CSV -- one to count, one to write both arrays a chunk at a time --
+// so a file of any size converts in a fixed amount of memory); csvStat is the CSV's
+// stat() from before the conversion, so a CSV changed meanwhile is converted again next time
+bool ConvertCsv(const char* csvPath, const char* binPath, const struct stat* csvStat)
+{
+    FILE* in = fopen(csvPath, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Cannot open %s\n", csvPath);
+        return false;
+    }
+
+    size_t count = 0;
+    char line[1024];
+    float lng, lat;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (ParseCsvLine(line, &lng, &lat))
+            count++;
+    }
+
+    int out = open(binPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        fprintf(stderr, "Cannot write %s\n", binPath);
+        fclose(in);
+        return false;
+    }
+
+    char header[POINTFILE_HEADER] = {};
+    struct pointfileheader* h = (struct pointfileheader*)header;
+    memcpy(h->magic, POINTFILE_MAGIC, 8);
+    h->count = count;
+    h->stride = PointStride(count);
+    h->csvSize = (uint64_t)csvStat->st_size;
+    h->csvSeconds = (int64_t)csvStat->st_mtim.tv_sec;
+    h->csvNanoseconds = (int64_t)csvStat->st_mtim.tv_nsec;
+    bool ok = pwrite(out, header, sizeof(header), 0) == (ssize_t)sizeof(header);
+
+    // the longitudes start after the header, the latitudes stride floats later:
+    const size_t chunk = 1 << 16;
+    float* longitude = new float[chunk];
+    float* latitude = new float[chunk];
+    off_t lngOffset = POINTFILE_HEADER;
+    off_t latOffset = POINTFILE_HEADER + h->stride * sizeof(float);
+    size_t used = 0;
+    rewind(in);
+    while (ok) {
+        bool more = fgets(line, sizeof(line), in) != NULL;
+        if (more && !ParseCsvLine(line, &longitude[used], &latitude[used]))
+            continue;
+        if (more)
+            used++;
+        if (used == chunk || (!more && used > 0)) {
+            ok = pwrite(out, longitude, used * sizeof(float), lngOffset) == (ssize_t)(used * sizeof(float))
+                && pwrite(out, latitude, used * sizeof(float), latOffset) == (ssize_t)(used * sizeof(float));
+            lngOffset += used * sizeof(float);
+            latOffset += used * sizeof(float);
+            used = 0;
+        }
+        if (!more)
+            break;
+    }
+    fclose(in);
+
+    // pad the latitudes out to stride (the longitudes' padding is the gap before them):
+    if (ok && ftruncate(out, POINTFILE_HEADER + 2 * h->stride * sizeof(float)) != 0)
+        ok = false;
+    if (close(out) != 0)
+        ok = false;
+
+    delete[] longitude;
+    delete[] latitude;
+
+    // a partial file would have the CSV's size and time in its header, and be used next time:
+    if (!ok) {
+        fprintf(stderr, "Cannot write %s\n", binPath);
+        unlink(binPath);
+    }
+    return ok;
+}
+
+// true if the binary point file was converted from the CSV as it is now
+bool PointFileCurrent(const char* binPath, const struct stat* csvStat)
+{
+    int fd = open(binPath, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct pointfileheader header;
+    bool current = read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header)
+        && memcmp(header.magic, POINTFILE_MAGIC, 8) == 0
+        && header.csvSize == (uint64_t)csvStat->st_size
+        && header.csvSeconds == (int64_t)csvStat->st_mtim.tv_sec
+        && header.csvNanoseconds == (int64_t)csvStat->st_mtim.tv_nsec;
+    close(fd);
+    return current;
+}
+
+// the binary point file for the given file, converting a CSV file if it has
+// changed since its binary file was written; an empty string if there is none
+std::string PointFileFor(const char* path)
+{
+    size_t length = strlen(path);
+    if (length > 4 && strcmp(path + length - 4, ".bin") == 0)
+        return path;
+
+    // reuse the binary point file if it was converted from this CSV:
+    std::string binPath = std::string(path) + ".bin";
+    struct stat csvStat;
+    if (stat(path, &csvStat) != 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return "";
+    }
+    if (!PointFileCurrent(binPath.c_str(), &csvStat)) {
+        if (!ConvertCsv(path, binPath.c_str(), &csvStat))
+            return "";
+    }
+    return binPath;
+}
+
+void FreePoints()
+{
+    if (MappedPoints != NULL)
+        munmap(MappedPoints, MappedBytes);
+    else
+        free(CityLongitude);
+    free(PointOrder);
+    free(PointPosition);
+    MappedPoints = NULL;
+    CityLongitude = CityLatitude = NULL;
+    PointOrder = PointPosition = NULL;
+}
+
+// false (after saying so) if there are fewer points than capitals to seed from them
+bool EnoughPoints(const char* name, long long count)
+{
+    if (count >= NUMCAPITALS)
+        return true;
+    fprintf(stderr, "%s has %lld points, fewer than the %d capitals\n", name, count, NUMCAPITALS);
+    return false;
+}
+
+// the points from the given file (see above), or Cities[] if path is NULL
+bool LoadPoints(const char* path)
+{
+    if (path == NULL) {
+        NumCities = (int)(sizeof(Cities) / sizeof(struct city));
+        size_t stride = PointStride(NumCities);
+        CityLongitude = (float*)aligned_alloc(64, 2 * stride * sizeof(float));
+        CityLatitude = CityLongitude + stride;
+        for (int i = 0; i < NumCities; i++) {
+            CityLongitude[i] = Cities[i].longitude;
+            CityLatitude[i] = Cities[i].latitude;
+        }
+        NamedCities = true;
+        if (EnoughPoints("UsCities.data", NumCities))
+            return true;
+        FreePoints();
+        return false;
+    }
+
+    std::string binPath = PointFileFor(path);
+    if (binPath.empty())
+        return false;
+    if (!MapPointFile(binPath.c_str()))
+        return false;
+    if (EnoughPoints(path, NumCities))
+        return true;
+    FreePoints();
+    return false;
+}
+
+// the name of point i, for printing the capitals
+std::string PointName(int i)
+{
+    if (PointOrder != NULL)
+        i = PointOrder[i];
+    if (NamedCities)
+        return Cities[i].name;
+    return "point " + std::to_string(i);
+}
+
+#endif // LOADER_H
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <stdio.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -5,6 +6,7 @@
 #include <stdlib.h>
 #include <string>
 #include <time.h>
+#include <vector>
 
 // setting the number of threads:
 #ifndef NUMT
@@ -19,39 +21,157 @@
 // maximum iterations to allow looking for convergence:
 #define MAXITERATIONS 100
 
+// converged once no city changes capital, or no capital moves more than this (degrees):
+#ifndef EPSILON
+#define EPSILON 1.e-5
+#endif
+
 // how many tries to discover the maximum performance:
 #define NUMTRIES 30
 
 #define CSV
 
+// how each city is summed into its capital:
+// with CRITICAL, every city adds itself in a critical section (the original, serializing baseline);
+// without it, every thread sums into its own partial sums, which are merged after the loop
+// #define CRITICAL
+
+// the nearest-capital kernel is picked at runtime for the CPU (AVX-512, AVX2 or scalar);
+// with SCALAR, the scalar kernel is always used
+// #define SCALAR
+
+// with GEMM, the kernels find the nearest capital as the smallest |c|² - 2 p·c, blocked
+// like a small matrix multiply with the argmin fused on (faster for large NUMCAPITALS)
+// #define GEMM
+
+// with HAMERLY, each city keeps bounds on its distances (Hamerly's algorithm)
+// so that most of the distances are never computed
+// #define HAMERLY
+
+// with KMEANSPP, the capitals are seeded with k-means|| (a parallel k-means++)
+// instead of cities at uniform intervals through the list
+// #define KMEANSPP
+
+// with MINIBATCH, mini-batch k-means streams the points through a fixed-size batch
+// instead of loading them all
+// #define MINIBATCH
+
+// with KDTREE, the city nearest each capital is looked up in a k-d tree built over the
+// cities instead of by scanning all of them for each capital
+// #define KDTREE
+
+// with SPHERE, distances are great-circle distances: the cities become unit vectors, the
+// nearest capital is the one with the largest dot product, and each capital is the mean
+// of its cities' vectors put back on the sphere
+// #define SPHERE
+
+// with SWEEP, one run solves every number of capitals from SWEEP_FIRST to NUMCAPITALS,
+// each starting from the solution for one fewer, and writes a line for each
+// #define SWEEP
+
+// with RESTARTS=R, R clusterings from different seeds run at once, a thread each,
+// and the one with the lowest inertia is kept
+// #define RESTARTS 8
+
+// with MORTON, the points are sorted into Z order (by their Morton codes) before
+// clustering, so that points next to each other in the arrays are near each other
+// #define MORTON
+
+// how many cities a thread hands to the kernel at a time (a multiple of 16):
+#ifndef ASSIGNBLOCK
+#define ASSIGNBLOCK 64
+#endif
+
+// the cities as UsCities.data lists them -- these are the points unless a point file
+// is given on the command line, and after startup only the names are used from here:
 struct city {
     std::string name;
     float longitude;
     float latitude;
-    int capitalnumber;
-    float mindistance;
 };
 
 #include "UsCities.data"
 
-// setting the number of cities we want to try:
-#define NUMCITIES (sizeof(Cities) / sizeof(struct city))
+// the number of cities, set by the loader:
+int NumCities;
+
+// the cities' coordinates and assignments as separate arrays (structure-of-arrays),
+// so the distance loops stream the 8 bytes per city they use and nothing else
+// (the coordinates are 64-byte aligned, and may be mapped straight from a point file):
+float* CityLongitude;
+float* CityLatitude;
+int* CityCapital;
+
+#include "loader.h"
 
 struct capital {
     std::string name;
     float longitude;
     float latitude;
-    float longsum;
-    float latsum;
+    double longsum; // (double, so that millions of points still add up)
+    double latsum;
     int numsum;
+#ifdef SPHERE
+    double xsum; // the sum of the cities' unit vectors
+    double ysum;
+    double zsum;
+#endif
 };
 
 struct capital Capitals[NUMCAPITALS];
 
+// one thread's partial sums for every capital, on cache lines of their own:
+struct alignas(64) partialsums {
+    double longsum[NUMCAPITALS];
+    double latsum[NUMCAPITALS];
+    int numsum[NUMCAPITALS];
+#ifdef SPHERE
+    double xsum[NUMCAPITALS];
+    double ysum[NUMCAPITALS];
+    double zsum[NUMCAPITALS];
+#endif
+};
+
+struct partialsums Partials[NUMT];
+
+// the capitals' coordinates as the kernels read them:
+alignas(64) float CapitalLongitude[NUMCAPITALS];
+alignas(64) float CapitalLatitude[NUMCAPITALS];
+
+#include "gemm.h"
+#include "assign.h"
+#include "hamerly.h"
+#include "seed.h"
+#include "minibatch.h"
+#include "kdtree.h"
+#include "sphere.h"
+#include "sweep.h"
+#ifdef RESTARTS
+#include "restart.h"
+#endif
+#include "morton.h"
+#include "counters.h"
+
+#if defined(SPHERE) && (defined(CRITICAL) || defined(HAMERLY) || defined(MINIBATCH) || defined(KDTREE))
+#error "SPHERE only works with the full-batch kernels"
+#endif
+
+#if defined(SWEEP) && (defined(CRITICAL) || defined(HAMERLY) || defined(MINIBATCH) || defined(SPHERE))
+#error "SWEEP only works with the full-batch planar kernels"
+#endif
+
+#if defined(RESTARTS) && (defined(CRITICAL) || defined(HAMERLY) || defined(MINIBATCH) || defined(SPHERE) || defined(SWEEP))
+#error "RESTARTS only works with the full-batch planar kernels"
+#endif
+
+#if defined(MORTON) && defined(MINIBATCH)
+#error "MORTON needs all the points loaded, so it cannot be used with MINIBATCH"
+#endif
+
 float Distance(int city, int capital)
 {
-    float dx = Cities[city].longitude - Capitals[capital].longitude;
-    float dy = Cities[city].latitude - Capitals[capital].latitude;
+    float dx = CityLongitude[city] - Capitals[capital].longitude;
+    float dy = CityLatitude[city] - Capitals[capital].latitude;
     return sqrtf(dx * dx + dy * dy);
 }
 
@@ -64,21 +184,100 @@ int main(int argc, char* argv[])
     return 1;
 #endif
 
+    omp_set_num_threads(NUMT); // set the number of threads to use in parallelizing the for-loop:
+
+    const char* kernelName;
+#if defined(CRITICAL) && !defined(MINIBATCH)
+    // (the critical-section loop calls Distance() itself)
+    kernelName = "critical";
+    (void)kernelName;
+#else
+    assignkernel assignKernel = SelectAssignKernel(&kernelName);
+#endif
+#if defined(HAMERLY) && !defined(MINIBATCH)
+    // (HamerlyAssign() does its own search)
+    kernelName = "hamerly";
+    (void)assignKernel;
+#endif
+#ifdef SPHERE
+    spherekernel sphereKernel = SelectSphereKernel(&kernelName);
+    (void)assignKernel;
+#endif
+
+    // every iteration's throughput, and the whole run's time to solution (seeding included):
+    std::vector<double> iterationRates;
+    int iterations = 0;
+    double pairs = 0.; // city-capital pairs the iterations covered
+    double distances = 0.; // city-capital distances actually computed
+    double timeToSolution, seedSeconds;
+    double inertia = 0.; // the sum of the squared distances to the nearest capital
+    double lookupSeconds = 0.; // finding the city nearest each capital
+    double sortSeconds = 0.; // putting the points in Z order
+    long long cacheMisses = -1; // during the iterations, if the CPU's counters can be read
+
+    long long numPoints; // (a streamed file may hold more points than an int can count)
+#ifdef MINIBATCH
+    // stream the points (a CSV or binary point file if one is given, otherwise UsCities.data):
+    iterations = MiniBatchRun((argc > 1) ? argv[1] : NULL, assignKernel, iterationRates, &numPoints, &timeToSolution, &seedSeconds, &inertia);
+    if (iterations < 0)
+        return 1;
+    pairs = distances = (double)numPoints * (double)NUMCAPITALS * (double)MINIBATCH_EPOCHS;
+#else
+    // the points: a CSV or binary point file if one is given, otherwise UsCities.data
+    if (!LoadPoints((argc > 1) ? argv[1] : NULL))
+        return 1;
+    numPoints = NumCities;
+#ifdef MORTON
+    double sortStart = omp_get_wtime();
+    MortonSort();
+    sortSeconds = omp_get_wtime() - sortStart;
+#endif
+    CityCapital = new int[NumCities];
+
     // make sure we have the data correctly:
-    // for (int i = 0; i < NUMCITIES; i++) {
+    // for (int i = 0; i < NumCities; i++) {
     //     fprintf(stderr, "%3d  %8.2f  %8.2f  %s\n", i, Cities[i].longitude, Cities[i].latitude, Cities[i].name.c_str());
     // }
 
-    omp_set_num_threads(NUMT); // set the number of threads to use in parallelizing the for-loop:
+    for (int i = 0; i < NumCities; i++)
+        CityCapital[i] = -1;
+
+#ifdef SWEEP
+    // solve every K on the points just loaded, and stop:
+    SweepK(assignKernel);
+    delete[] CityCapital;
+    FreePoints();
+    return 0;
+#endif
+
+#ifdef RESTARTS
+    // solve RESTARTS times from different seeds, keep the best, and stop:
+    RestartK(assignKernel);
+    delete[] CityCapital;
+    FreePoints();
+    return 0;
+#endif
+
+#ifdef HAMERLY
+    HamerlyInit(NumCities);
+#endif
+#ifdef SPHERE
+    SphereInit();
+#endif
+
+    double timeStart = omp_get_wtime();
 
     // seed the capitals:
+#ifdef KMEANSPP
+    SeedKMeansParallel();
+#else
     // (this is just picking initial capital cities at uniform intervals)
-    for (int k = 0; k < NUMCAPITALS; k++) {
-        int cityIndex = k * (NUMCITIES - 1) / (NUMCAPITALS - 1);
-        Capitals[k].longitude = Cities[cityIndex].longitude;
-        Capitals[k].latitude = Cities[cityIndex].latitude;
-    }
+    SeedUniform();
+#endif
+    seedSeconds = omp_get_wtime() - timeStart;
 
+    CounterOpen();
+    long long missesStart = CounterRead();
     double time0, time1;
     for (int n = 0; n < MAXITERATIONS; n++) {
         // reset the summations for the capitals:
@@ -86,53 +285,290 @@ int main(int argc, char* argv[])
             Capitals[k].longsum = 0.;
             Capitals[k].latsum = 0.;
             Capitals[k].numsum = 0;
+#ifdef SPHERE
+            Capitals[k].xsum = Capitals[k].ysum = Capitals[k].zsum = 0.;
+#endif
         }
 
         time0 = omp_get_wtime();
 
-#pragma omp parallel for default(none) shared(Capitals, Cities)
-        for (int i = 0; i < NUMCITIES; i++) {
-            int capitalnumber = -1;
+        // how many cities changed capital this iteration:
+        int reassigned = 0;
+        long long computed = (long long)NumCities * NUMCAPITALS; // unless the bounds skip some
+
+#ifdef CRITICAL
+#pragma omp parallel for default(none) shared(Capitals, NumCities, CityLongitude, CityLatitude, CityCapital) reduction(+ : reassigned)
+        for (int i = 0; i < NumCities; i++) {
+            int previous = CityCapital[i];
             float mindistance = 1.e+37;
 
             for (int k = 0; k < NUMCAPITALS; k++) {
                 float dist = Distance(i, k);
                 if (dist < mindistance) {
                     mindistance = dist;
-                    capitalnumber = k;
-                    Cities[i].capitalnumber = k;
+                    CityCapital[i] = k;
                 }
             }
 
-            int k = Cities[i].capitalnumber;
+            int k = CityCapital[i];
+            if (k != previous)
+                reassigned++;
 
 // this is here for the same reason as the Trapezoid noteset uses it:
 #pragma omp critical
             {
-                Capitals[k].longsum += Cities[i].longitude;
-                Capitals[k].latsum += Cities[i].latitude;
+                Capitals[k].longsum += CityLongitude[i];
+                Capitals[k].latsum += CityLatitude[i];
                 Capitals[k].numsum++;
             }
         }
+#else
+        for (int k = 0; k < NUMCAPITALS; k++) {
+            CapitalLongitude[k] = Capitals[k].longitude;
+            CapitalLatitude[k] = Capitals[k].latitude;
+#ifdef SPHERE
+            double x, y, z;
+            ToUnit(Capitals[k].longitude, Capitals[k].latitude, &x, &y, &z);
+            CapitalX[k] = (float)x;
+            CapitalY[k] = (float)y;
+            CapitalZ[k] = (float)z;
+#endif
+        }
+#ifdef HAMERLY
+        HamerlyPrepare();
+        computed = 0;
+#endif
+
+#ifdef SPHERE
+#pragma omp parallel default(none) shared(NumCities, CityX, CityY, CityZ, CityCapital, Partials, CapitalX, CapitalY, CapitalZ, sphereKernel) reduction(+ : reassigned, computed)
+#else
+#pragma omp parallel default(none) shared(NumCities, CityLongitude, CityLatitude, CityCapital, Partials, CapitalLongitude, CapitalLatitude, assignKernel) reduction(+ : reassigned, computed)
+#endif
+        {
+            // each thread only ever touches its own partial sums:
+            struct partialsums* mine = &Partials[omp_get_thread_num()];
+            for (int k = 0; k < NUMCAPITALS; k++) {
+                mine->longsum[k] = 0.;
+                mine->latsum[k] = 0.;
+                mine->numsum[k] = 0;
+#ifdef SPHERE
+                mine->xsum[k] = mine->ysum[k] = mine->zsum[k] = 0.;
+#endif
+            }
+
+#ifdef HAMERLY
+#pragma omp for
+            for (int i = 0; i < NumCities; i++) {
+                int previous = CityCapital[i];
+                computed += HamerlyAssign(i);
+
+                int capitalnumber = CityCapital[i];
+                if (capitalnumber != previous)
+                    reassigned++;
+                mine->longsum[capitalnumber] += CityLongitude[i];
+                mine->latsum[capitalnumber] += CityLatitude[i];
+                mine->numsum[capitalnumber]++;
+            }
+#elif defined(SPHERE)
+#pragma omp for
+            for (int first = 0; first < NumCities; first += ASSIGNBLOCK) {
+                int last = (first + ASSIGNBLOCK < NumCities) ? first + ASSIGNBLOCK : NumCities;
+                int previous[ASSIGNBLOCK];
+                for (int i = first; i < last; i++)
+                    previous[i - first] = CityCapital[i];
+
+                sphereKernel(first, last, CityX, CityY, CityZ, CapitalX, CapitalY, CapitalZ, NUMCAPITALS, CityCapital);
+
+                for (int i = first; i < last; i++) {
+                    int capitalnumber = CityCapital[i];
+                    if (capitalnumber != previous[i - first])
+                        reassigned++;
+                    mine->xsum[capitalnumber] += CityX[i];
+                    mine->ysum[capitalnumber] += CityY[i];
+                    mine->zsum[capitalnumber] += CityZ[i];
+                    mine->numsum[capitalnumber]++;
+                }
+            }
+#else
+#pragma omp for
+            for (int first = 0; first < NumCities; first += ASSIGNBLOCK) {
+                int last = (first + ASSIGNBLOCK < NumCities) ? first + ASSIGNBLOCK : NumCities;
+                int previous[ASSIGNBLOCK];
+                for (int i = first; i < last; i++)
+                    previous[i - first] = CityCapital[i];
+
+                assignKernel(first, last, CityLongitude, CityLatitude, CapitalLongitude, CapitalLatitude, NUMCAPITALS, CityCapital);
+
+                // a block of points near each other (in Z order, most of them) often all go to
+                // one capital, and are then summed together instead of into its sums one at a time:
+                int blockCapital = CityCapital[first];
+                int same = first + 1;
+                while (same < last && CityCapital[same] == blockCapital)
+                    same++;
+                if (same == last) {
+                    double longsum = 0., latsum = 0.;
+#pragma omp simd reduction(+ : longsum, latsum, reassigned)
+                    for (int i = first; i < last; i++) {
+                        longsum += CityLongitude[i];
+                        latsum += CityLatitude[i];
+                        reassigned += (previous[i - first] != blockCapital);
+                    }
+                    mine->longsum[blockCapital] += longsum;
+                    mine->latsum[blockCapital] += latsum;
+                    mine->numsum[blockCapital] += last - first;
+                    continue;
+                }
+
+                for (int i = first; i < last; i++) {
+                    int capitalnumber = CityCapital[i];
+                    if (capitalnumber != previous[i - first])
+                        reassigned++;
+                    mine->longsum[capitalnumber] += CityLongitude[i];
+                    mine->latsum[capitalnumber] += CityLatitude[i];
+                    mine->numsum[capitalnumber]++;
+                }
+            }
+#endif
+        }
+
+        // merge the threads' partial sums:
+        for (int t = 0; t < NUMT; t++) {
+            for (int k = 0; k < NUMCAPITALS; k++) {
+                Capitals[k].longsum += Partials[t].longsum[k];
+                Capitals[k].latsum += Partials[t].latsum[k];
+                Capitals[k].numsum += Partials[t].numsum[k];
+#ifdef SPHERE
+                Capitals[k].xsum += Partials[t].xsum[k];
+                Capitals[k].ysum += Partials[t].ysum[k];
+                Capitals[k].zsum += Partials[t].zsum[k];
+#endif
+            }
+        }
+#endif
         time1 = omp_get_wtime();
+        iterationRates.push_back((double)NumCities * (double)NUMCAPITALS / (time1 - time0) / 1000000.);
+        iterations++;
+        pairs += (double)NumCities * (double)NUMCAPITALS;
+        distances += computed;
 
-        // get the average longitude and latitude for each capital:
+        // get the average longitude and latitude for each capital
+        // (a capital that got no cities stays where it is):
+        float maxShift = 0.;
         for (int k = 0; k < NUMCAPITALS; k++) {
-            Capitals[k].longitude = Capitals[k].longsum / Capitals[k].numsum;
-            Capitals[k].latitude = Capitals[k].latsum / Capitals[k].numsum;
+#ifdef HAMERLY
+            CapitalShift[k] = 0.;
+#endif
+            if (Capitals[k].numsum == 0)
+                continue;
+#ifdef SPHERE
+            // (the mean vector is inside the sphere; scaling it back out does not change where it points)
+            float longitude, latitude;
+            FromUnit(Capitals[k].xsum, Capitals[k].ysum, Capitals[k].zsum, &longitude, &latitude);
+            double x0, y0, z0, x1, y1, z1;
+            ToUnit(Capitals[k].longitude, Capitals[k].latitude, &x0, &y0, &z0);
+            ToUnit(longitude, latitude, &x1, &y1, &z1);
+            float shift = SphereAngle(x0, y0, z0, x1, y1, z1);
+#else
+            float longitude = Capitals[k].longsum / Capitals[k].numsum;
+            float latitude = Capitals[k].latsum / Capitals[k].numsum;
+            float shift = sqrtf((longitude - Capitals[k].longitude) * (longitude - Capitals[k].longitude)
+                + (latitude - Capitals[k].latitude) * (latitude - Capitals[k].latitude));
+#endif
+            if (shift > maxShift)
+                maxShift = shift;
+#ifdef HAMERLY
+            CapitalShift[k] = shift;
+#endif
+            Capitals[k].longitude = longitude;
+            Capitals[k].latitude = latitude;
         }
+
+        if (reassigned == 0 || maxShift < EPSILON)
+            break;
+    }
+
+    timeToSolution = omp_get_wtime() - timeStart;
+    long long missesEnd = CounterRead();
+    if (missesStart >= 0 && missesEnd >= 0)
+        cacheMisses = missesEnd - missesStart;
+    CounterClose();
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        CapitalLongitude[k] = Capitals[k].longitude;
+        CapitalLatitude[k] = Capitals[k].latitude;
     }
+#ifdef HAMERLY
+    HamerlyFree();
+#endif
 
-    double megaCityCapitalsPerSecond = (double)NUMCITIES * (double)NUMCAPITALS / (time1 - time0) / 1000000.;
+    // the inertia of the final capitals:
+#ifdef SPHERE
+    // (in km²)
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        double x, y, z;
+        ToUnit(Capitals[k].longitude, Capitals[k].latitude, &x, &y, &z);
+        CapitalX[k] = (float)x;
+        CapitalY[k] = (float)y;
+        CapitalZ[k] = (float)z;
+    }
+#pragma omp parallel for default(none) shared(NumCities, CityX, CityY, CityZ, CapitalX, CapitalY, CapitalZ) reduction(+ : inertia)
+    for (int i = 0; i < NumCities; i++) {
+        float maxdot = -2.;
+        for (int k = 0; k < NUMCAPITALS; k++) {
+            float dot = CityX[i] * CapitalX[k] + CityY[i] * CapitalY[k] + CityZ[i] * CapitalZ[k];
+            if (dot > maxdot)
+                maxdot = dot;
+        }
+        double km = SphereKm(maxdot);
+        inertia += km * km;
+    }
+#else
+#pragma omp parallel for default(none) shared(NumCities, CityLongitude, CityLatitude, Capitals) reduction(+ : inertia)
+    for (int i = 0; i < NumCities; i++) {
+        float mindistance = 1.e+37;
+        for (int k = 0; k < NUMCAPITALS; k++) {
+            float dx = CityLongitude[i] - Capitals[k].longitude;
+            float dy = CityLatitude[i] - Capitals[k].latitude;
+            float dist = dx * dx + dy * dy;
+            if (dist < mindistance)
+                mindistance = dist;
+        }
+        inertia += mindistance;
+    }
+#endif
 
     // figure out what actual city is closest to each capital:
+    double lookupStart = omp_get_wtime();
+#ifdef KDTREE
+    struct kdtree cityTree;
+    KdBuild(&cityTree, CityLongitude, CityLatitude, NumCities);
+    int nearestCity[NUMCAPITALS];
+    KdNearestBatch(&cityTree, CapitalLongitude, CapitalLatitude, NUMCAPITALS, nearestCity);
+    KdFree(&cityTree);
+    for (int k = 0; k < NUMCAPITALS; k++)
+        Capitals[k].name = PointName(nearestCity[k]);
+#elif defined(SPHERE)
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        int minCity = -1;
+        float maxdot = -2.;
+
+        for (int i = 0; i < NumCities; i++) {
+            float dot = CityX[i] * CapitalX[k] + CityY[i] * CapitalY[k] + CityZ[i] * CapitalZ[k];
+            if (dot > maxdot) {
+                maxdot = dot;
+                minCity = i;
+            }
+        }
+
+        Capitals[k].name = PointName(minCity);
+    }
+#else
     for (int k = 0; k < NUMCAPITALS; k++) {
         int minCity = -1;
         float minDist = 1.e+37;
 
-        for (int i = 0; i < NUMCITIES; i++) {
-            float dx = Cities[i].longitude - Capitals[k].longitude;
-            float dy = Cities[i].latitude - Capitals[k].latitude;
+        for (int i = 0; i < NumCities; i++) {
+            float dx = CityLongitude[i] - Capitals[k].longitude;
+            float dy = CityLatitude[i] - Capitals[k].latitude;
             float dist = sqrtf(dx * dx + dy * dy);
             if (dist < minDist) {
                 minDist = dist;
@@ -140,7 +576,28 @@ int main(int argc, char* argv[])
             }
         }
 
-        Capitals[k].name = Cities[minCity].name;
+        Capitals[k].name = PointName(minCity);
+    }
+#endif
+    lookupSeconds = omp_get_wtime() - lookupStart;
+#endif
+
+    // the share of the brute-force distances that were skipped:
+    double skippedPercent = 100. * (1. - distances / pairs);
+
+    // the iterations' throughput (in city-capital pairs and in points), and the spread of the
+    // individual iterations' throughputs:
+    double megaCityCapitalsPerSecond = pairs / (timeToSolution - seedSeconds) / 1000000.;
+    double megaPointsPerSecond = megaCityCapitalsPerSecond / NUMCAPITALS;
+    double gigaFlopsPerSecond = megaCityCapitalsPerSecond * AssignFlops / 1000.;
+    // (0 if no iteration was timed)
+    double p05 = 0., p50 = 0., p95 = 0.;
+    if (!iterationRates.empty()) {
+        int last = (int)iterationRates.size() - 1;
+        std::sort(iterationRates.begin(), iterationRates.end());
+        p05 = iterationRates[(int)(0.05 * last + 0.5)];
+        p50 = iterationRates[(int)(0.50 * last + 0.5)];
+        p95 = iterationRates[(int)(0.95 * last + 0.5)];
     }
 
     // print the longitude-latitude of each new capital city:
@@ -150,13 +607,28 @@ int main(int argc, char* argv[])
             fprintf(stdout, "\t%3d:  %8.2f , %8.2f , %s\n", k, Capitals[k].longitude, Capitals[k].latitude, Capitals[k].name.c_str());
         }
     }
+    // NUMT,NUMCITIES,NUMCAPITALS,MegaCityCapitalsPerSecond,Iterations,Seconds,P05,P50,P95,SkippedPercent,SeedSeconds,Inertia,MegaPointsPerSecond,LookupSeconds,GFlopsPerSecond,SortSeconds,CacheMisses
+    // (the throughput is over all the iterations, counting every city-capital pair whether or not its
+    // distance was skipped; P05 - P95 are percentiles of the iterations' throughputs; Seconds includes SeedSeconds;
+    // with MINIBATCH, the iterations are the batches; LookupSeconds is the search for the city nearest each capital;
+    // CacheMisses are the last-level cache misses during the iterations, or -1 if they cannot be counted)
 #ifdef CSV
-    fprintf(stderr, "%2d , %4d , %4d , %8.3lf\n", NUMT, NUMCITIES, NUMCAPITALS, megaCityCapitalsPerSecond);
+    fprintf(stderr, "%2d , %4lld , %4d , %8.3lf , %3d , %10.6lf , %8.3lf , %8.3lf , %8.3lf , %6.2lf , %10.6lf , %14.4lf , %8.3lf , %10.6lf , %8.3lf , %10.6lf , %lld\n",
+        NUMT, numPoints, NUMCAPITALS, megaCityCapitalsPerSecond, iterations, timeToSolution, p05, p50, p95, skippedPercent, seedSeconds, inertia, megaPointsPerSecond, lookupSeconds, gigaFlopsPerSecond, sortSeconds, cacheMisses);
     if (NUMT == 1) {
-        fprintf(stdout, "%2d , %4d , %4d , %8.3lf\n", NUMT, NUMCITIES, NUMCAPITALS, megaCityCapitalsPerSecond);
+        fprintf(stdout, "%2d , %4lld , %4d , %8.3lf , %3d , %10.6lf , %8.3lf , %8.3lf , %8.3lf , %6.2lf , %10.6lf , %14.4lf , %8.3lf , %10.6lf , %8.3lf , %10.6lf , %lld\n",
+            NUMT, numPoints, NUMCAPITALS, megaCityCapitalsPerSecond, iterations, timeToSolution, p05, p50, p95, skippedPercent, seedSeconds, inertia, megaPointsPerSecond, lookupSeconds, gigaFlopsPerSecond, sortSeconds, cacheMisses);
     }
 #else
-    fprintf(stderr, "%2d threads : %4d cities ; %4d capitals; megatrials/sec = %8.3lf\n",
-        NUMT, NUMCITIES, NUMCAPITALS, megaCityCapitalsPerSecond);
+    fprintf(stderr, "%2d threads : %4lld cities ; %4d capitals; %s kernel; %d iterations in %.6lf sec; megatrials/sec = %8.3lf (iterations: %8.3lf - %8.3lf - %8.3lf); %.2lf%% of the distances skipped; seeded in %.6lf sec; inertia = %.4lf; megapoints/sec = %8.3lf; nearest cities found in %.6lf sec; GFLOP/s = %8.3lf; sorted in %.6lf sec; %lld cache misses\n",
+        NUMT, numPoints, NUMCAPITALS, kernelName, iterations, timeToSolution, megaCityCapitalsPerSecond, p05, p50, p95, skippedPercent, seedSeconds, inertia, megaPointsPerSecond, lookupSeconds, gigaFlopsPerSecond, sortSeconds, cacheMisses);
+#endif
+
+#ifndef MINIBATCH
+#ifdef SPHERE
+    SphereFree();
+#endif
+    delete[] CityCapital;
+    FreePoints();
 #endif
 }
@@ -0,0 +1,333 @@
+#ifndef MINIBATCH_H
+#define MINIBATCH_H
+
+// Mini-batch k-means (Sculley), streaming the points from a point file.
+// Instead of loading every point, the points are read MINIBATCH_SIZE at a time
+// into the same few buffers, so memory use does not grow with the file. Each
+// batch is assigned to the capitals in parallel exactly like a full iteration,
+// then every capital moves towards the mean of its batch points with its own
+// learning rate: the points in this batch over all the points it has been
+// given so far, so a capital slows down as it settles. The file is streamed
+// MINIBATCH_EPOCHS times, then once more to measure the inertia (the sum of the
+// squared distances to the nearest capital) and find the point nearest each
+// capital.
+//
+// The early batches move the capitals the most, so they have to be a fair
+// sample: read in file order, a file sorted by population or by place would
+// pull every capital towards its start. So the file is cut into chunks of
+// MINIBATCH_CHUNK points, and each epoch reads the chunks in its own shuffled
+// order, chunk j of the order being (Step * j + Offset) mod NumChunks with a
+// random Step that has no factor in common with NumChunks. That visits every
+// chunk once an epoch, takes no memory, and each batch gathers chunks from all
+// over the file with one pread() per chunk and array.
+//
+// Without a file the compiled-in cities are "streamed" from memory.
+//
+// Include this after loader.h, seed.h, the kernels and Partials[].
+
+#include <vector>
+
+// points per batch (a multiple of ASSIGNBLOCK):
+#ifndef MINIBATCH_SIZE
+#define MINIBATCH_SIZE (1 << 16)
+#endif
+
+// passes over the points:
+#ifndef MINIBATCH_EPOCHS
+#define MINIBATCH_EPOCHS 3
+#endif
+
+// points read together from one place in the file (MINIBATCH_SIZE must be a multiple of it):
+#ifndef MINIBATCH_CHUNK
+#define MINIBATCH_CHUNK 4096
+#endif
+
+#if MINIBATCH_SIZE % MINIBATCH_CHUNK != 0
+#error "MINIBATCH_SIZE must be a multiple of MINIBATCH_CHUNK"
+#endif
+
+// where the batches come from: a binary point file, or arrays already in memory
+struct pointstream {
+    int Fd;
+    long long Count;
+    long long Stride;
+    const float* Longitude;
+    const float* Latitude;
+};
+
+bool OpenPointStream(const char* path, struct pointstream* s)
+{
+    if (path == NULL) {
+        if (!LoadPoints(NULL))
+            return false;
+        s->Fd = -1;
+        s->Count = NumCities;
+        s->Stride = 0;
+        s->Longitude = CityLongitude;
+        s->Latitude = CityLatitude;
+        return true;
+    }
+
+    std::string binPath = PointFileFor(path);
+    if (binPath.empty())
+        return false;
+    struct pointfileheader header;
+    s->Fd = open(binPath.c_str(), O_RDONLY);
+    if (s->Fd < 0 || pread(s->Fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+        || memcmp(header.magic, POINTFILE_MAGIC, 8) != 0 || header.stride < header.count) {
+        fprintf(stderr, "%s is not a point file\n", binPath.c_str());
+        if (s->Fd >= 0)
+            close(s->Fd);
+        return false;
+    }
+    if (!EnoughPoints(path, (long long)header.count)) {
+        close(s->Fd);
+        return false;
+    }
+    posix_fadvise(s->Fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    s->Count = (long long)header.count;
+    s->Stride = (long long)header.stride;
+    return true;
+}
+
+// read points first - first+n-1 into the buffers
+bool ReadPoints(const struct pointstream* s, long long first, int n, float* longitude, float* latitude)
+{
+    if (s->Fd < 0) {
+        memcpy(longitude, s->Longitude + first, n * sizeof(float));
+        memcpy(latitude, s->Latitude + first, n * sizeof(float));
+        return true;
+    }
+
+    ssize_t bytes = (ssize_t)n * sizeof(float);
+    off_t lngOffset = POINTFILE_HEADER + first * sizeof(float);
+    off_t latOffset = POINTFILE_HEADER + (s->Stride + first) * sizeof(float);
+    return pread(s->Fd, longitude, bytes, lngOffset) == bytes && pread(s->Fd, latitude, bytes, latOffset) == bytes;
+}
+
+// the order an epoch reads the chunks in (see above), and how far it has got:
+struct chunkorder {
+    long long NumChunks;
+    long long Step;
+    long long Next; // the next chunk to read
+    long long Left; // chunks still to read this epoch
+};
+
+// a random number in [0,n) for the given epoch and draw (SeedRandom()'s hash, 64 bits of it)
+long long ShuffleRandom(int epoch, uint32_t draw, long long n)
+{
+    uint32_t round = (uint32_t)epoch * 0x9e3779b9;
+    uint64_t high = SeedMix(SeedMix((2 * draw) ^ SeedMix(KMEANSPP_SEED)) + round);
+    uint64_t low = SeedMix(SeedMix((2 * draw + 1) ^ SeedMix(KMEANSPP_SEED)) + round);
+    return (long long)(((high << 32) | low) % (uint64_t)n);
+}
+
+void ShuffleChunks(long long count, int epoch, struct chunkorder* order)
+{
+    order->NumChunks = (count + MINIBATCH_CHUNK - 1) / MINIBATCH_CHUNK;
+    uint32_t draw = 0;
+    for (;;) {
+        // (a step with no factor in common with NumChunks comes back to the start only after every chunk)
+        long long step = ShuffleRandom(epoch, draw++, order->NumChunks);
+        long long a = step, b = order->NumChunks;
+        while (b != 0) {
+            long long r = a % b;
+            a = b;
+            b = r;
+        }
+        if (a == 1) {
+            order->Step = step;
+            break;
+        }
+    }
+    order->Next = ShuffleRandom(epoch, draw, order->NumChunks);
+    order->Left = order->NumChunks;
+}
+
+// read the next MINIBATCH_SIZE / MINIBATCH_CHUNK chunks of the order into the buffers;
+// the number of points read, or -1
+int ReadBatch(const struct pointstream* s, struct chunkorder* order, float* longitude, float* latitude)
+{
+    int n = 0;
+    for (int c = 0; c < MINIBATCH_SIZE / MINIBATCH_CHUNK && order->Left > 0; c++) {
+        long long first = order->Next * MINIBATCH_CHUNK;
+        int size = (int)((s->Count - first < MINIBATCH_CHUNK) ? s->Count - first : MINIBATCH_CHUNK);
+        if (!ReadPoints(s, first, size, longitude + n, latitude + n))
+            return -1;
+        n += size;
+        order->Next += order->Step;
+        if (order->Next >= order->NumChunks)
+            order->Next -= order->NumChunks;
+        order->Left--;
+    }
+    return n;
+}
+
+void ClosePointStream(struct pointstream* s)
+{
+    if (s->Fd >= 0)
+        close(s->Fd);
+    else
+        free((void*)s->Longitude); // LoadPoints() allocated both arrays as one block
+}
+
+// run mini-batch k-means over the points in the given file (or the cities if path is NULL);
+// fills in each batch's throughput, the time to solution (seeding and batches) and the
+// inertia, and returns the number of batches, or -1 on an error
+int MiniBatchRun(const char* path, assignkernel assignKernel, std::vector<double>& batchRates,
+    long long* numPoints, double* seconds, double* seedSeconds, double* inertia)
+{
+    struct pointstream stream;
+    if (!OpenPointStream(path, &stream))
+        return -1;
+
+    // the only per-point memory: one batch of coordinates and capitals
+    float* batchLongitude = (float*)aligned_alloc(64, MINIBATCH_SIZE * sizeof(float));
+    float* batchLatitude = (float*)aligned_alloc(64, MINIBATCH_SIZE * sizeof(float));
+    int* batchCapital = new int[MINIBATCH_SIZE];
+
+    // the batch stands in for the cities, so the seeding and the loops below use it:
+    CityLongitude = batchLongitude;
+    CityLatitude = batchLatitude;
+    CityCapital = batchCapital;
+
+    // seed the capitals from the first batch:
+    double timeStart = omp_get_wtime();
+    double time0 = timeStart;
+    struct chunkorder order;
+    ShuffleChunks(stream.Count, 0, &order);
+    NumCities = ReadBatch(&stream, &order, batchLongitude, batchLatitude);
+    bool ok = NumCities > 0;
+#ifdef KMEANSPP
+    SeedKMeansParallel();
+#else
+    SeedUniform();
+#endif
+    *seedSeconds = omp_get_wtime() - time0;
+
+    // how many points each capital has been given so far:
+    long long given[NUMCAPITALS] = {};
+    int batches = 0;
+    for (int epoch = 0; epoch < MINIBATCH_EPOCHS && ok; epoch++) {
+        ShuffleChunks(stream.Count, epoch, &order);
+        while (order.Left > 0 && ok) {
+            time0 = omp_get_wtime();
+            NumCities = ReadBatch(&stream, &order, batchLongitude, batchLatitude);
+            ok = NumCities > 0;
+
+            for (int k = 0; k < NUMCAPITALS; k++) {
+                CapitalLongitude[k] = Capitals[k].longitude;
+                CapitalLatitude[k] = Capitals[k].latitude;
+            }
+
+#pragma omp parallel default(none) shared(NumCities, CityLongitude, CityLatitude, CityCapital, Partials, CapitalLongitude, CapitalLatitude, assignKernel)
+            {
+                struct partialsums* mine = &Partials[omp_get_thread_num()];
+                for (int k = 0; k < NUMCAPITALS; k++) {
+                    mine->longsum[k] = 0.;
+                    mine->latsum[k] = 0.;
+                    mine->numsum[k] = 0;
+                }
+
+#pragma omp for
+                for (int first = 0; first < NumCities; first += ASSIGNBLOCK) {
+                    int last = (first + ASSIGNBLOCK < NumCities) ? first + ASSIGNBLOCK : NumCities;
+                    assignKernel(first, last, CityLongitude, CityLatitude, CapitalLongitude, CapitalLatitude, NUMCAPITALS, CityCapital);
+                    for (int i = first; i < last; i++) {
+                        int capitalnumber = CityCapital[i];
+                        mine->longsum[capitalnumber] += CityLongitude[i];
+                        mine->latsum[capitalnumber] += CityLatitude[i];
+                        mine->numsum[capitalnumber]++;
+                    }
+                }
+            }
+
+            // move each capital towards its batch mean, at the rate batch points / all points given:
+            for (int k = 0; k < NUMCAPITALS; k++) {
+                double longsum = 0., latsum = 0.;
+                int numsum = 0;
+                for (int t = 0; t < NUMT; t++) {
+                    longsum += Partials[t].longsum[k];
+                    latsum += Partials[t].latsum[k];
+                    numsum += Partials[t].numsum[k];
+                }
+                if (numsum == 0)
+                    continue;
+                given[k] += numsum;
+                double rate = (double)numsum / (double)given[k];
+                Capitals[k].longitude += rate * (longsum / numsum - Capitals[k].longitude);
+                Capitals[k].latitude += rate * (latsum / numsum - Capitals[k].latitude);
+            }
+
+            batchRates.push_back((double)NumCities * (double)NUMCAPITALS / (omp_get_wtime() - time0) / 1000000.);
+            batches++;
+        }
+    }
+
+    *seconds = omp_get_wtime() - timeStart;
+
+    // one more pass: the inertia, and the point nearest each capital
+    double sum = 0.;
+    long long nearestPoint[NUMCAPITALS];
+    float nearestDist[NUMCAPITALS];
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        nearestPoint[k] = -1;
+        nearestDist[k] = 1.e+37;
+    }
+    for (long long start = 0; start < stream.Count && ok; start += MINIBATCH_SIZE) {
+        NumCities = (int)((stream.Count - start < MINIBATCH_SIZE) ? stream.Count - start : MINIBATCH_SIZE);
+        ok = ReadPoints(&stream, start, NumCities, batchLongitude, batchLatitude);
+
+#pragma omp parallel default(none) shared(NumCities, CityLongitude, CityLatitude, Capitals, nearestPoint, nearestDist, start) reduction(+ : sum)
+        {
+            long long myPoint[NUMCAPITALS];
+            float myDist[NUMCAPITALS];
+            for (int k = 0; k < NUMCAPITALS; k++) {
+                myPoint[k] = -1;
+                myDist[k] = 1.e+37;
+            }
+
+#pragma omp for
+            for (int i = 0; i < NumCities; i++) {
+                float mindistance = 1.e+37;
+                for (int k = 0; k < NUMCAPITALS; k++) {
+                    float dx = CityLongitude[i] - Capitals[k].longitude;
+                    float dy = CityLatitude[i] - Capitals[k].latitude;
+                    float dist = dx * dx + dy * dy;
+                    if (dist < mindistance)
+                        mindistance = dist;
+                    if (dist < myDist[k]) {
+                        myDist[k] = dist;
+                        myPoint[k] = start + i;
+                    }
+                }
+                sum += mindistance;
+            }
+
+#pragma omp critical
+            for (int k = 0; k < NUMCAPITALS; k++) {
+                if (myDist[k] < nearestDist[k] || (myDist[k] == nearestDist[k] && myPoint[k] < nearestPoint[k])) {
+                    nearestDist[k] = myDist[k];
+                    nearestPoint[k] = myPoint[k];
+                }
+            }
+        }
+    }
+    for (int k = 0; k < NUMCAPITALS; k++)
+        Capitals[k].name = NamedCities ? Cities[nearestPoint[k]].name : "point " + std::to_string(nearestPoint[k]);
+
+    *numPoints = stream.Count;
+    *inertia = sum;
+    free(batchLongitude);
+    free(batchLatitude);
+    delete[] batchCapital;
+    CityCapital = NULL;
+    ClosePointStream(&stream);
+    if (!ok) {
+        fprintf(stderr, "Cannot read the points\n");
+        return -1;
+    }
+    return batches;
+}
+
+#endif // MINIBATCH_H
@@ -0,0 +1,169 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+// Z-order (Morton) sorting of the points.
+// UsCities.data is sorted by population, so cities next to each other in the
+// arrays are usually far apart on the map, and so are the points of most
+// files. MortonSort() reorders the points along a Z-order curve: each point's
+// longitude and latitude are scaled to 16-bit integers over the points'
+// bounding box, and their bits are interleaved into one 32-bit code,
+//
+//   code = ... y2 x2 y1 x1 y0 x0
+//
+// so that points with nearby codes are nearby on the map. The codes are
+// sorted with a parallel LSD radix sort, 8 bits a pass: each thread counts the
+// digits of its own share of the points, the counts give every thread its own
+// place in each bucket, and each thread then moves its points there, so the
+// sort is stable and needs no atomics or locks. A pass in which every point
+// has the same digit is skipped.
+//
+// PointOrder (loader.h) keeps each point's original number, so PointName()
+// still names the right city, and PointPosition the way back, so the uniform
+// seeds (SeedUniformIndex()) are the same cities as without the sort.
+//
+// Include this after loader.h.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// bits of the code a radix sort pass sorts on:
+#define MORTON_RADIX 8
+#define MORTON_BUCKETS (1 << MORTON_RADIX)
+
+// the low 16 bits of v, spread out to the even bits
+inline uint32_t MortonSpread(uint32_t v)
+{
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+inline uint32_t MortonCode(uint32_t x, uint32_t y)
+{
+    return MortonSpread(x) | (MortonSpread(y) << 1);
+}
+
+// sort keys[0] - keys[n-1], and values[] with them, using temporaries of the same size
+void MortonRadixSort(uint32_t* keys, int* values, uint32_t* keyTemp, int* valueTemp, int n)
+{
+    // each thread's count of each digit, then where its next point with that digit goes:
+    static int counts[NUMT][MORTON_BUCKETS];
+    uint32_t* sortedKeys = keys;
+    int* sortedValues = values;
+
+    for (int shift = 0; shift < 32; shift += MORTON_RADIX) {
+        bool skip = false;
+#pragma omp parallel default(none) shared(sortedKeys, sortedValues, keyTemp, valueTemp, n, shift, skip, counts)
+        {
+            int t = omp_get_thread_num();
+            int numThreads = omp_get_num_threads();
+            int first = (int)((long long)n * t / numThreads);
+            int last = (int)((long long)n * (t + 1) / numThreads);
+
+            int* mine = counts[t];
+            for (int d = 0; d < MORTON_BUCKETS; d++)
+                mine[d] = 0;
+            for (int i = first; i < last; i++)
+                mine[(sortedKeys[i] >> shift) & (MORTON_BUCKETS - 1)]++;
+
+            // bucket by bucket, and thread by thread within a bucket:
+#pragma omp barrier
+#pragma omp single
+            {
+                int offset = 0;
+                for (int d = 0; d < MORTON_BUCKETS; d++) {
+                    int bucketStart = offset;
+                    for (int u = 0; u < numThreads; u++) {
+                        int count = counts[u][d];
+                        counts[u][d] = offset;
+                        offset += count;
+                    }
+                    if (offset - bucketStart == n)
+                        skip = true;
+                }
+            }
+
+            if (!skip) {
+                for (int i = first; i < last; i++) {
+                    int to = mine[(sortedKeys[i] >> shift) & (MORTON_BUCKETS - 1)]++;
+                    keyTemp[to] = sortedKeys[i];
+                    valueTemp[to] = sortedValues[i];
+                }
+            }
+        }
+
+        if (!skip) {
+            uint32_t* k = sortedKeys;
+            sortedKeys = keyTemp;
+            keyTemp = k;
+            int* v = sortedValues;
+            sortedValues = valueTemp;
+            valueTemp = v;
+        }
+    }
+
+    // (after an odd number of passes the sorted points are in the temporaries)
+    if (sortedKeys != keys) {
+#pragma omp parallel for default(none) shared(keys, values, sortedKeys, sortedValues, n)
+        for (int i = 0; i < n; i++) {
+            keys[i] = sortedKeys[i];
+            values[i] = sortedValues[i];
+        }
+    }
+}
+
+// put the points in Z order, remembering each one's original number in PointOrder
+// and where each original point went in PointPosition
+void MortonSort()
+{
+    // the bounding box:
+    float minLng = 1.e+37, maxLng = -1.e+37, minLat = 1.e+37, maxLat = -1.e+37;
+#pragma omp parallel for default(none) shared(NumCities, CityLongitude, CityLatitude) reduction(min : minLng, minLat) reduction(max : maxLng, maxLat)
+    for (int i = 0; i < NumCities; i++) {
+        minLng = (CityLongitude[i] < minLng) ? CityLongitude[i] : minLng;
+        maxLng = (CityLongitude[i] > maxLng) ? CityLongitude[i] : maxLng;
+        minLat = (CityLatitude[i] < minLat) ? CityLatitude[i] : minLat;
+        maxLat = (CityLatitude[i] > maxLat) ? CityLatitude[i] : maxLat;
+    }
+    float lngScale = (maxLng > minLng) ? 65535.f / (maxLng - minLng) : 0.f;
+    float latScale = (maxLat > minLat) ? 65535.f / (maxLat - minLat) : 0.f;
+
+    int n = NumCities;
+    uint32_t* keys = new uint32_t[2 * (size_t)n];
+    int* order = (int*)malloc(2 * (size_t)n * sizeof(int));
+#pragma omp parallel for default(none) shared(n, CityLongitude, CityLatitude, minLng, minLat, lngScale, latScale, keys, order)
+    for (int i = 0; i < n; i++) {
+        uint32_t x = (uint32_t)((CityLongitude[i] - minLng) * lngScale);
+        uint32_t y = (uint32_t)((CityLatitude[i] - minLat) * latScale);
+        keys[i] = MortonCode((x < 65535) ? x : 65535, (y < 65535) ? y : 65535);
+        order[i] = i;
+    }
+    MortonRadixSort(keys, order, keys + n, order + n, n);
+    delete[] keys;
+    order = (int*)realloc(order, (size_t)n * sizeof(int));
+
+    // the coordinates in the new order (a mapped point file is left as it is):
+    size_t stride = PointStride(n);
+    float* longitude = (float*)aligned_alloc(64, 2 * stride * sizeof(float));
+    float* latitude = longitude + stride;
+#pragma omp parallel for default(none) shared(n, CityLongitude, CityLatitude, order, longitude, latitude)
+    for (int i = 0; i < n; i++) {
+        longitude[i] = CityLongitude[order[i]];
+        latitude[i] = CityLatitude[order[i]];
+    }
+    int* position = (int*)malloc((size_t)n * sizeof(int));
+#pragma omp parallel for default(none) shared(n, order, position)
+    for (int i = 0; i < n; i++)
+        position[order[i]] = i;
+
+    FreePoints();
+    CityLongitude = longitude;
+    CityLatitude = latitude;
+    PointOrder = order;
+    PointPosition = position;
+}
+
+#endif // MORTON_H
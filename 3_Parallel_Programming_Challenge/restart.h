@@ -0,0 +1,160 @@
+#ifndef RESTART_H
+#define RESTART_H
+
+// Best-of-R k-means.
+// Lloyd's iterations only find the local optimum nearest where they start, so
+// a single run's answer depends on its seeds. With RESTARTS=R the program
+// solves R clusterings from different seeds and keeps the one with the lowest
+// inertia. Restart 0 starts from the usual uniform-interval seeds (SeedUniformIndex()),
+// so the best is never worse than the single run; the others start from
+// NUMCAPITALS different points picked at random (a hash of the restart and the
+// draw, drawing again when a point has already been picked).
+//
+// The restarts are independent, so they are what is parallelized: each one is
+// a loop iteration handed to the next free thread (schedule(dynamic, 1), in
+// effect a task per restart), and runs serially inside with the vectorized
+// kernel. Nothing is shared while they run -- each keeps its capitals and sums
+// on its own stack and never stores the assignments, stopping when no capital
+// moves more than EPSILON -- so R restarts on R cores take about as long as one.
+//
+// Include this after seed.h, the kernels and PointName().
+
+// the outcome of one restart:
+struct restart {
+    float Longitude[NUMCAPITALS];
+    float Latitude[NUMCAPITALS];
+    double Inertia;
+    int Iterations;
+};
+
+// solve restart r on the calling thread
+void RestartSolve(int r, assignkernel assignKernel, struct restart* result)
+{
+    alignas(64) float capLongitude[NUMCAPITALS];
+    alignas(64) float capLatitude[NUMCAPITALS];
+    int picked[NUMCAPITALS];
+    uint32_t draw = 0;
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        int cityIndex = SeedUniformIndex(k, NUMCAPITALS);
+        // (without replacement, so that no two capitals start on the same point)
+        for (bool again = (r != 0); again;) {
+            cityIndex = SeedPosition((int)(SeedRandom(1000 + r, draw++) * NumCities));
+            again = false;
+            for (int j = 0; j < k; j++)
+                again = again || picked[j] == cityIndex;
+        }
+        picked[k] = cityIndex;
+        capLongitude[k] = CityLongitude[cityIndex];
+        capLatitude[k] = CityLatitude[cityIndex];
+    }
+
+    int iterations = 0;
+    for (int n = 0; n < MAXITERATIONS; n++) {
+        double longsum[NUMCAPITALS] = {}, latsum[NUMCAPITALS] = {};
+        int numsum[NUMCAPITALS] = {};
+        int capital[ASSIGNBLOCK];
+        for (int first = 0; first < NumCities; first += ASSIGNBLOCK) {
+            int last = (first + ASSIGNBLOCK < NumCities) ? first + ASSIGNBLOCK : NumCities;
+            assignKernel(0, last - first, CityLongitude + first, CityLatitude + first,
+                capLongitude, capLatitude, NUMCAPITALS, capital);
+            for (int i = first; i < last; i++) {
+                int capitalnumber = capital[i - first];
+                longsum[capitalnumber] += CityLongitude[i];
+                latsum[capitalnumber] += CityLatitude[i];
+                numsum[capitalnumber]++;
+            }
+        }
+        iterations++;
+
+        float maxShift = 0.;
+        for (int k = 0; k < NUMCAPITALS; k++) {
+            if (numsum[k] == 0)
+                continue;
+            float longitude = longsum[k] / numsum[k];
+            float latitude = latsum[k] / numsum[k];
+            float shift = sqrtf((longitude - capLongitude[k]) * (longitude - capLongitude[k])
+                + (latitude - capLatitude[k]) * (latitude - capLatitude[k]));
+            if (shift > maxShift)
+                maxShift = shift;
+            capLongitude[k] = longitude;
+            capLatitude[k] = latitude;
+        }
+
+        if (maxShift < EPSILON)
+            break;
+    }
+
+    double inertia = 0.;
+    for (int i = 0; i < NumCities; i++) {
+        float mindistance = 1.e+37;
+        for (int k = 0; k < NUMCAPITALS; k++) {
+            float dx = CityLongitude[i] - capLongitude[k];
+            float dy = CityLatitude[i] - capLatitude[k];
+            float dist = dx * dx + dy * dy;
+            if (dist < mindistance)
+                mindistance = dist;
+        }
+        inertia += mindistance;
+    }
+
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        result->Longitude[k] = capLongitude[k];
+        result->Latitude[k] = capLatitude[k];
+    }
+    result->Inertia = inertia;
+    result->Iterations = iterations;
+}
+
+// run all the restarts, keep the best in Capitals[], and write
+// NUMT,NUMCITIES,NUMCAPITALS,Restarts,RestartsPerSecond,Seconds,BestInertia,FirstInertia,MeanIterations
+// (FirstInertia is restart 0's, the single run's answer)
+void RestartK(assignkernel assignKernel)
+{
+    struct restart* results = new struct restart[RESTARTS];
+
+    double time0 = omp_get_wtime();
+#pragma omp parallel for default(none) shared(assignKernel, results) schedule(dynamic, 1)
+    for (int r = 0; r < RESTARTS; r++)
+        RestartSolve(r, assignKernel, &results[r]);
+    double seconds = omp_get_wtime() - time0;
+
+    int best = 0;
+    double iterations = 0.;
+    for (int r = 0; r < RESTARTS; r++) {
+        if (results[r].Inertia < results[best].Inertia)
+            best = r;
+        iterations += results[r].Iterations;
+    }
+
+    // name the best capitals after their nearest cities:
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        Capitals[k].longitude = results[best].Longitude[k];
+        Capitals[k].latitude = results[best].Latitude[k];
+
+        int minCity = -1;
+        float minDist = 1.e+37;
+        for (int i = 0; i < NumCities; i++) {
+            float dx = CityLongitude[i] - Capitals[k].longitude;
+            float dy = CityLatitude[i] - Capitals[k].latitude;
+            float dist = dx * dx + dy * dy;
+            if (dist < minDist) {
+                minDist = dist;
+                minCity = i;
+            }
+        }
+        Capitals[k].name = PointName(minCity);
+    }
+
+    if (NUMT == 1) {
+        for (int k = 0; k < NUMCAPITALS; k++) {
+            fprintf(stdout, "\t%3d:  %8.2f , %8.2f , %s\n", k, Capitals[k].longitude, Capitals[k].latitude, Capitals[k].name.c_str());
+        }
+    }
+    fprintf(stderr, "%2d , %4d , %4d , %4d , %10.3lf , %10.6lf , %14.4lf , %14.4lf , %6.2lf\n",
+        NUMT, NumCities, NUMCAPITALS, RESTARTS, RESTARTS / seconds, seconds, results[best].Inertia, results[0].Inertia,
+        iterations / RESTARTS);
+
+    delete[] results;
+}
+
+#endif // RESTART_H
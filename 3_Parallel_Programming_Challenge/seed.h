@@ -0,0 +1,208 @@
+#ifndef SEED_H
+#define SEED_H
+
+// The k-means|| seeding (Bahmani et al.'s parallel k-means++).
+// k-means++ picks each seed with probability proportional to its squared
+// distance D² from the seeds already picked, which spreads the seeds over the
+// clusters, but it needs K passes over the points, one after another.
+// k-means|| instead makes a few passes that each keep every point with
+// probability min(1, l D² / phi), phi being the sum of D², so each pass picks
+// about l = KMEANSPP_OVERSAMPLE * K candidates at once. Each pass is a parallel
+// loop and a reduction. The candidates are then weighted by how many points
+// are nearest to them, and a weighted k-means++ over that small set picks the
+// K seeds.
+//
+// The random numbers are a hash of the seed, the round and the point's number,
+// so the candidates do not depend on the number of threads.
+//
+// Include this after the City* arrays, Capitals[] and ASSIGNBLOCK.
+
+#include <stdint.h>
+#include <vector>
+
+// how many sampling passes, and how many candidates each is expected to pick per capital:
+#ifndef KMEANSPP_ROUNDS
+#define KMEANSPP_ROUNDS 5
+#endif
+
+#ifndef KMEANSPP_OVERSAMPLE
+#define KMEANSPP_OVERSAMPLE 2
+#endif
+
+#ifndef KMEANSPP_SEED
+#define KMEANSPP_SEED 1
+#endif
+
+// a well-mixed 32-bit hash (lowbias32):
+inline uint32_t SeedMix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// a uniform number in [0,1) for point i in the given round:
+inline double SeedRandom(uint32_t round, uint32_t i)
+{
+    uint32_t bits = SeedMix(SeedMix(i ^ SeedMix(KMEANSPP_SEED)) + round * 0x9e3779b9);
+    return (bits >> 8) * (1. / 16777216.);
+}
+
+// where the city with the given original number is now, so that seeds picked by
+// number do not move when the points are reordered
+inline int SeedPosition(int original)
+{
+    return (PointPosition != NULL) ? PointPosition[original] : original;
+}
+
+// the k-th of numCapitals cities at uniform intervals through the list
+inline int SeedUniformIndex(int k, int numCapitals)
+{
+    return SeedPosition((numCapitals > 1) ? (int)((long long)k * (NumCities - 1) / (numCapitals - 1)) : 0);
+}
+
+// the original seeding: cities at uniform intervals through the list
+void SeedUniform()
+{
+    for (int k = 0; k < NUMCAPITALS; k++) {
+        int cityIndex = SeedUniformIndex(k, NUMCAPITALS);
+        Capitals[k].longitude = CityLongitude[cityIndex];
+        Capitals[k].latitude = CityLatitude[cityIndex];
+    }
+}
+
+// the squared distance from city i to candidate point c:
+inline float SeedDistance2(int i, int c)
+{
+    float dx = CityLongitude[i] - CityLongitude[c];
+    float dy = CityLatitude[i] - CityLatitude[c];
+    return dx * dx + dy * dy;
+}
+
+// k-means|| seeding; returns how many candidates it picked
+int SeedKMeansParallel()
+{
+    float* nearestDist = new float[NumCities]; // D² to the nearest candidate
+    int* nearest = new int[NumCities]; // which candidate that is
+
+    std::vector<int> candidates;
+    candidates.push_back((int)(SeedRandom(0, 0) * NumCities));
+
+    // every point starts out nearest to the first candidate:
+    double phi = 0.;
+    int first = candidates[0];
+#pragma omp parallel for default(none) shared(NumCities, nearestDist, nearest, first) reduction(+ : phi)
+    for (int i = 0; i < NumCities; i++) {
+        nearestDist[i] = SeedDistance2(i, first);
+        nearest[i] = 0;
+        phi += nearestDist[i];
+    }
+
+    double oversample = (double)KMEANSPP_OVERSAMPLE * NUMCAPITALS;
+    for (int round = 1; round <= KMEANSPP_ROUNDS && phi > 0.; round++) {
+        // keep each point with probability l D² / phi (each thread's picks in order of i):
+        std::vector<int> picked[NUMT];
+#pragma omp parallel default(none) shared(NumCities, nearestDist, picked, phi, oversample, round)
+        {
+            std::vector<int>* mine = &picked[omp_get_thread_num()];
+#pragma omp for schedule(static)
+            for (int i = 0; i < NumCities; i++) {
+                if (SeedRandom(round, i) * phi < oversample * nearestDist[i])
+                    mine->push_back(i);
+            }
+        }
+
+        int firstNew = (int)candidates.size();
+        for (int t = 0; t < NUMT; t++)
+            candidates.insert(candidates.end(), picked[t].begin(), picked[t].end());
+        int numCandidates = (int)candidates.size();
+        if (numCandidates == firstNew)
+            continue;
+
+        // bring D² up to date with the new candidates
+        // (a block of points at a time against each candidate, so the inner loop vectorizes):
+        int* newCandidates = &candidates[firstNew];
+        phi = 0.;
+#pragma omp parallel for default(none) shared(NumCities, CityLongitude, CityLatitude, nearestDist, nearest, newCandidates, firstNew, numCandidates) reduction(+ : phi)
+        for (int first = 0; first < NumCities; first += ASSIGNBLOCK) {
+            int last = (first + ASSIGNBLOCK < NumCities) ? first + ASSIGNBLOCK : NumCities;
+            for (int c = firstNew; c < numCandidates; c++) {
+                float x = CityLongitude[newCandidates[c - firstNew]];
+                float y = CityLatitude[newCandidates[c - firstNew]];
+                for (int i = first; i < last; i++) {
+                    float dx = CityLongitude[i] - x;
+                    float dy = CityLatitude[i] - y;
+                    float d = dx * dx + dy * dy;
+                    nearest[i] = (d < nearestDist[i]) ? c : nearest[i];
+                    nearestDist[i] = (d < nearestDist[i]) ? d : nearestDist[i];
+                }
+            }
+            for (int i = first; i < last; i++)
+                phi += nearestDist[i];
+        }
+    }
+
+    // weigh each candidate by the points nearest to it:
+    int numCandidates = (int)candidates.size();
+    std::vector<double> weight(numCandidates, 0.);
+#pragma omp parallel default(none) shared(NumCities, nearest, weight, numCandidates)
+    {
+        std::vector<double> mine(numCandidates, 0.);
+#pragma omp for
+        for (int i = 0; i < NumCities; i++)
+            mine[nearest[i]] += 1.;
+#pragma omp critical
+        for (int c = 0; c < numCandidates; c++)
+            weight[c] += mine[c];
+    }
+
+    // weighted k-means++ over the candidates (serial -- there are only a few hundred):
+    std::vector<double> candidateDist(numCandidates, 1.e+37);
+    int seeds = 0;
+    int chosen = 0;
+    for (int c = 1; c < numCandidates; c++) {
+        if (weight[c] > weight[chosen])
+            chosen = c;
+    }
+    while (seeds < NUMCAPITALS && chosen >= 0) {
+        Capitals[seeds].longitude = CityLongitude[candidates[chosen]];
+        Capitals[seeds].latitude = CityLatitude[candidates[chosen]];
+        seeds++;
+
+        double total = 0.;
+        for (int c = 0; c < numCandidates; c++) {
+            double d = SeedDistance2(candidates[c], candidates[chosen]);
+            if (d < candidateDist[c])
+                candidateDist[c] = d;
+            total += weight[c] * candidateDist[c];
+        }
+
+        // the next seed, with probability proportional to weight * D²:
+        chosen = -1;
+        double target = SeedRandom(KMEANSPP_ROUNDS + seeds, 0) * total;
+        for (int c = 0; c < numCandidates && total > 0.; c++) {
+            if (weight[c] * candidateDist[c] <= 0.)
+                continue;
+            chosen = c;
+            target -= weight[c] * candidateDist[c];
+            if (target < 0.)
+                break;
+        }
+    }
+
+    // fewer distinct candidates than capitals (tiny inputs): fill in from the uniform seeds
+    for (int k = seeds; k < NUMCAPITALS; k++) {
+        int cityIndex = SeedUniformIndex(k, NUMCAPITALS);
+        Capitals[k].longitude = CityLongitude[cityIndex];
+        Capitals[k].latitude = CityLatitude[cityIndex];
+    }
+
+    delete[] nearestDist;
+    delete[] nearest;
+    return numCandidates;
+}
+
+#endif // SEED_H
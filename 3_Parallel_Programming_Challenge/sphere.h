@@ -0,0 +1,184 @@
+#ifndef SPHERE_H
+#define SPHERE_H
+
+// Great-circle k-means.
+// Longitude and latitude are not planar coordinates: a degree of longitude
+// is 111 km at the equator but under 80 km at the latitude of Seattle. Instead
+// of evaluating the haversine formula for every city and capital, each point is
+// turned once into a unit vector on the sphere,
+//
+//   x = cos(lat) cos(long)   y = cos(lat) sin(long)   z = sin(lat)
+//
+// and the great-circle distance between two points is acos of their vectors'
+// dot product. acos only gets smaller as the dot product grows, so the nearest
+// capital is the one with the largest dot product: three multiply-adds per
+// city and capital, vectorized exactly like the planar kernels but keeping an
+// argmax. A capital's new position is the mean of its cities' vectors scaled
+// back onto the sphere.
+//
+// Include this after NUMCAPITALS, NumCities and the City* arrays.
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdlib.h>
+
+// kilometres per radian:
+#define EARTH_RADIUS 6371.0088
+
+// the cities as unit vectors:
+float* CityX;
+float* CityY;
+float* CityZ;
+
+// the capitals as unit vectors, as the kernels read them:
+alignas(64) float CapitalX[NUMCAPITALS];
+alignas(64) float CapitalY[NUMCAPITALS];
+alignas(64) float CapitalZ[NUMCAPITALS];
+
+void ToUnit(double longitude, double latitude, double* x, double* y, double* z)
+{
+    double lng = longitude * (M_PI / 180.);
+    double lat = latitude * (M_PI / 180.);
+    *x = cos(lat) * cos(lng);
+    *y = cos(lat) * sin(lng);
+    *z = sin(lat);
+}
+
+void FromUnit(double x, double y, double z, float* longitude, float* latitude)
+{
+    *longitude = (float)(atan2(y, x) * (180. / M_PI));
+    *latitude = (float)(atan2(z, sqrt(x * x + y * y)) * (180. / M_PI));
+}
+
+// the great-circle distance in km between two unit vectors with the given dot product
+inline double SphereKm(double dot)
+{
+    dot = (dot > 1.) ? 1. : (dot < -1.) ? -1. : dot;
+    return EARTH_RADIUS * acos(dot);
+}
+
+// the angle in degrees between two unit vectors (from their chord, which stays
+// accurate for the tiny angles convergence is judged by)
+inline double SphereAngle(double x0, double y0, double z0, double x1, double y1, double z1)
+{
+    double chord = sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0) + (z1 - z0) * (z1 - z0));
+    return 2. * asin((chord < 2.) ? chord / 2. : 1.) * (180. / M_PI);
+}
+
+// every city's unit vector, computed in parallel once
+void SphereInit()
+{
+    size_t stride = (NumCities + 15) / 16 * 16;
+    CityX = (float*)aligned_alloc(64, 3 * stride * sizeof(float));
+    CityY = CityX + stride;
+    CityZ = CityY + stride;
+
+#pragma omp parallel for default(none) shared(NumCities, CityLongitude, CityLatitude, CityX, CityY, CityZ)
+    for (int i = 0; i < NumCities; i++) {
+        double x, y, z;
+        ToUnit(CityLongitude[i], CityLatitude[i], &x, &y, &z);
+        CityX[i] = (float)x;
+        CityY[i] = (float)y;
+        CityZ[i] = (float)z;
+    }
+}
+
+void SphereFree()
+{
+    free(CityX);
+    CityX = CityY = CityZ = NULL;
+}
+
+typedef void (*spherekernel)(int first, int last, const float* x, const float* y, const float* z,
+    const float* capX, const float* capY, const float* capZ, int numCapitals, int* capital);
+
+void AssignSphereScalar(int first, int last, const float* x, const float* y, const float* z,
+    const float* capX, const float* capY, const float* capZ, int numCapitals, int* capital)
+{
+    for (int i = first; i < last; i++) {
+        int capitalnumber = 0;
+        float maxdot = -2.;
+
+        for (int k = 0; k < numCapitals; k++) {
+            float dot = x[i] * capX[k] + y[i] * capY[k] + z[i] * capZ[k];
+            if (dot > maxdot) {
+                maxdot = dot;
+                capitalnumber = k;
+            }
+        }
+
+        capital[i] = capitalnumber;
+    }
+}
+
+__attribute__((target("avx2,fma"))) void AssignSphereAvx2(int first, int last, const float* x, const float* y, const float* z,
+    const float* capX, const float* capY, const float* capZ, int numCapitals, int* capital)
+{
+    int i = first;
+    for (; i + 8 <= last; i += 8) {
+        __m256 px = _mm256_loadu_ps(&x[i]);
+        __m256 py = _mm256_loadu_ps(&y[i]);
+        __m256 pz = _mm256_loadu_ps(&z[i]);
+        __m256 best = _mm256_set1_ps(-2.f);
+        __m256i bestk = _mm256_setzero_si256();
+
+        for (int k = 0; k < numCapitals; k++) {
+            __m256 dot = _mm256_mul_ps(px, _mm256_set1_ps(capX[k]));
+            dot = _mm256_fmadd_ps(py, _mm256_set1_ps(capY[k]), dot);
+            dot = _mm256_fmadd_ps(pz, _mm256_set1_ps(capZ[k]), dot);
+            __m256 nearer = _mm256_cmp_ps(dot, best, _CMP_GT_OQ);
+            best = _mm256_blendv_ps(best, dot, nearer);
+            bestk = _mm256_blendv_epi8(bestk, _mm256_set1_epi32(k), _mm256_castps_si256(nearer));
+        }
+
+        _mm256_storeu_si256((__m256i*)&capital[i], bestk);
+    }
+
+    AssignSphereScalar(i, last, x, y, z, capX, capY, capZ, numCapitals, capital);
+}
+
+__attribute__((target("avx512f"))) void AssignSphereAvx512(int first, int last, const float* x, const float* y, const float* z,
+    const float* capX, const float* capY, const float* capZ, int numCapitals, int* capital)
+{
+    int i = first;
+    for (; i + 16 <= last; i += 16) {
+        __m512 px = _mm512_loadu_ps(&x[i]);
+        __m512 py = _mm512_loadu_ps(&y[i]);
+        __m512 pz = _mm512_loadu_ps(&z[i]);
+        __m512 best = _mm512_set1_ps(-2.f);
+        __m512i bestk = _mm512_setzero_si512();
+
+        for (int k = 0; k < numCapitals; k++) {
+            __m512 dot = _mm512_mul_ps(px, _mm512_set1_ps(capX[k]));
+            dot = _mm512_fmadd_ps(py, _mm512_set1_ps(capY[k]), dot);
+            dot = _mm512_fmadd_ps(pz, _mm512_set1_ps(capZ[k]), dot);
+            __mmask16 nearer = _mm512_cmp_ps_mask(dot, best, _CMP_GT_OQ);
+            best = _mm512_mask_blend_ps(nearer, best, dot);
+            bestk = _mm512_mask_blend_epi32(nearer, bestk, _mm512_set1_epi32(k));
+        }
+
+        _mm512_storeu_si512((void*)&capital[i], bestk);
+    }
+
+    AssignSphereScalar(i, last, x, y, z, capX, capY, capZ, numCapitals, capital);
+}
+
+// the widest sphere kernel this CPU can run (or the scalar one if SCALAR is defined):
+spherekernel SelectSphereKernel(const char** name)
+{
+#ifndef SCALAR
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        *name = "sphere-avx512";
+        return AssignSphereAvx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        *name = "sphere-avx2";
+        return AssignSphereAvx2;
+    }
+#endif
+    *name = "sphere-scalar";
+    return AssignSphereScalar;
+}
+
+#endif // SPHERE_H
@@ -0,0 +1,243 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+// The K sweep.
+// Instead of one build and one run per number of capitals, one run loads the
+// points once and solves K = SWEEP_FIRST, ..., NUMCAPITALS in turn with the
+// same thread team (Capitals[] and the partial sums are sized for the largest
+// K, and the kernels take K at runtime). Each K starts from the previous
+// solution: the capitals are kept, and one more is added at a point picked
+// with probability proportional to its squared distance from the nearest
+// capital (a k-means++ step), so each K usually converges in a few iterations.
+// The pass that makes that pick also gives the previous K's inertia.
+//
+// For every K a line goes to stderr with the inertia (for an elbow plot) and
+// the mean silhouette of up to SWEEP_SAMPLE points spread through the list:
+// for each, a is its mean distance to the other sampled points of its own
+// capital and b the smallest mean distance to the sampled points of another
+// capital, and its silhouette is (b - a) / max(a, b). Near 1 the capitals'
+// regions are well separated; near 0 they blur into each other.
+//
+// Include this after seed.h and the kernels.
+
+#include <vector>
+
+// the smallest K the sweep solves (the largest is NUMCAPITALS):
+#ifndef SWEEP_FIRST
+#define SWEEP_FIRST 2
+#endif
+
+// most points the silhouette is computed over:
+#ifndef SWEEP_SAMPLE
+#define SWEEP_SAMPLE 2000
+#endif
+
+// Lloyd's iterations for the first numCapitals capitals, from where they are now;
+// returns the number of iterations
+int SweepSolve(int numCapitals, assignkernel assignKernel)
+{
+    int iterations = 0;
+    for (int n = 0; n < MAXITERATIONS; n++) {
+        for (int k = 0; k < numCapitals; k++) {
+            CapitalLongitude[k] = Capitals[k].longitude;
+            CapitalLatitude[k] = Capitals[k].latitude;
+        }
+
+        int reassigned = 0;
+#pragma omp parallel default(none) shared(NumCities, CityLongitude, CityLatitude, CityCapital, Partials, CapitalLongitude, CapitalLatitude, assignKernel, numCapitals) reduction(+ : reassigned)
+        {
+            struct partialsums* mine = &Partials[omp_get_thread_num()];
+            for (int k = 0; k < numCapitals; k++) {
+                mine->longsum[k] = 0.;
+                mine->latsum[k] = 0.;
+                mine->numsum[k] = 0;
+            }
+
+#pragma omp for
+            for (int first = 0; first < NumCities; first += ASSIGNBLOCK) {
+                int last = (first + ASSIGNBLOCK < NumCities) ? first + ASSIGNBLOCK : NumCities;
+                int previous[ASSIGNBLOCK];
+                for (int i = first; i < last; i++)
+                    previous[i - first] = CityCapital[i];
+
+                assignKernel(first, last, CityLongitude, CityLatitude, CapitalLongitude, CapitalLatitude, numCapitals, CityCapital);
+
+                for (int i = first; i < last; i++) {
+                    int capitalnumber = CityCapital[i];
+                    if (capitalnumber != previous[i - first])
+                        reassigned++;
+                    mine->longsum[capitalnumber] += CityLongitude[i];
+                    mine->latsum[capitalnumber] += CityLatitude[i];
+                    mine->numsum[capitalnumber]++;
+                }
+            }
+        }
+        iterations++;
+
+        float maxShift = 0.;
+        for (int k = 0; k < numCapitals; k++) {
+            double longsum = 0., latsum = 0.;
+            int numsum = 0;
+            for (int t = 0; t < NUMT; t++) {
+                longsum += Partials[t].longsum[k];
+                latsum += Partials[t].latsum[k];
+                numsum += Partials[t].numsum[k];
+            }
+            if (numsum == 0)
+                continue;
+            float longitude = longsum / numsum;
+            float latitude = latsum / numsum;
+            float shift = sqrtf((longitude - Capitals[k].longitude) * (longitude - Capitals[k].longitude)
+                + (latitude - Capitals[k].latitude) * (latitude - Capitals[k].latitude));
+            if (shift > maxShift)
+                maxShift = shift;
+            Capitals[k].longitude = longitude;
+            Capitals[k].latitude = latitude;
+        }
+
+        if (reassigned == 0 || maxShift < EPSILON)
+            break;
+    }
+    return iterations;
+}
+
+// the inertia of the first numCapitals capitals; if there is room for another capital,
+// it is put at a point picked with probability proportional to its squared distance
+double SweepInertiaAndGrow(int numCapitals)
+{
+    // the squared distances summed per block, so the pick can find its block without a second full pass:
+    int numBlocks = (NumCities + ASSIGNBLOCK - 1) / ASSIGNBLOCK;
+    std::vector<double> blockSums(numBlocks);
+    double* sums = blockSums.data();
+    double inertia = 0.;
+#pragma omp parallel for default(none) shared(NumCities, CityLongitude, CityLatitude, Capitals, sums, numBlocks, numCapitals) reduction(+ : inertia)
+    for (int b = 0; b < numBlocks; b++) {
+        int last = (b * ASSIGNBLOCK + ASSIGNBLOCK < NumCities) ? b * ASSIGNBLOCK + ASSIGNBLOCK : NumCities;
+        double sum = 0.;
+        for (int i = b * ASSIGNBLOCK; i < last; i++) {
+            float mindistance = 1.e+37;
+            for (int k = 0; k < numCapitals; k++) {
+                float dx = CityLongitude[i] - Capitals[k].longitude;
+                float dy = CityLatitude[i] - Capitals[k].latitude;
+                float dist = dx * dx + dy * dy;
+                if (dist < mindistance)
+                    mindistance = dist;
+            }
+            sum += mindistance;
+        }
+        sums[b] = sum;
+        inertia += sum;
+    }
+
+    if (numCapitals >= NUMCAPITALS || inertia <= 0.)
+        return inertia;
+
+    // find the block, then the point, where the running sum passes the target:
+    double target = SeedRandom(KMEANSPP_ROUNDS + 1 + numCapitals, 1) * inertia;
+    int b = 0;
+    while (b < numBlocks - 1 && target >= sums[b]) {
+        target -= sums[b];
+        b++;
+    }
+    int last = (b * ASSIGNBLOCK + ASSIGNBLOCK < NumCities) ? b * ASSIGNBLOCK + ASSIGNBLOCK : NumCities;
+    int picked = last - 1;
+    for (int i = b * ASSIGNBLOCK; i < last; i++) {
+        float mindistance = 1.e+37;
+        for (int k = 0; k < numCapitals; k++) {
+            float dx = CityLongitude[i] - Capitals[k].longitude;
+            float dy = CityLatitude[i] - Capitals[k].latitude;
+            float dist = dx * dx + dy * dy;
+            if (dist < mindistance)
+                mindistance = dist;
+        }
+        target -= mindistance;
+        if (target < 0. && mindistance > 0.) {
+            picked = i;
+            break;
+        }
+    }
+
+    Capitals[numCapitals].longitude = CityLongitude[picked];
+    Capitals[numCapitals].latitude = CityLatitude[picked];
+    return inertia;
+}
+
+// the mean silhouette of up to SWEEP_SAMPLE points, with the first numCapitals capitals
+double SweepSilhouette(int numCapitals)
+{
+    int numSamples = (NumCities < SWEEP_SAMPLE) ? NumCities : SWEEP_SAMPLE;
+    std::vector<float> sampleLongitude(numSamples), sampleLatitude(numSamples);
+    std::vector<int> sampleCapital(numSamples);
+    for (int s = 0; s < numSamples; s++) {
+        int i = (int)((long long)s * NumCities / numSamples);
+        sampleLongitude[s] = CityLongitude[i];
+        sampleLatitude[s] = CityLatitude[i];
+    }
+    AssignScalar(0, numSamples, sampleLongitude.data(), sampleLatitude.data(), CapitalLongitude, CapitalLatitude, numCapitals, sampleCapital.data());
+
+    const float* x = sampleLongitude.data();
+    const float* y = sampleLatitude.data();
+    const int* c = sampleCapital.data();
+    double total = 0.;
+#pragma omp parallel for default(none) shared(x, y, c, numSamples, numCapitals) reduction(+ : total) schedule(dynamic, 16)
+    for (int s = 0; s < numSamples; s++) {
+        double distSum[NUMCAPITALS] = {};
+        int count[NUMCAPITALS] = {};
+        for (int j = 0; j < numSamples; j++) {
+            float dx = x[s] - x[j];
+            float dy = y[s] - y[j];
+            distSum[c[j]] += sqrtf(dx * dx + dy * dy);
+            count[c[j]]++;
+        }
+
+        // a point alone in its region has a silhouette of 0:
+        if (count[c[s]] <= 1)
+            continue;
+        double a = distSum[c[s]] / (count[c[s]] - 1);
+        double b = 1.e+37;
+        for (int k = 0; k < numCapitals; k++) {
+            if (k != c[s] && count[k] > 0 && distSum[k] / count[k] < b)
+                b = distSum[k] / count[k];
+        }
+        if (b < 1.e+37)
+            total += (b - a) / ((a > b) ? a : b);
+    }
+    return total / numSamples;
+}
+
+// solve every K from SWEEP_FIRST to NUMCAPITALS, writing a line per K:
+// NUMT,NUMCITIES,K,MegaCityCapitalsPerSecond,Iterations,Seconds,Inertia,Silhouette,SilhouetteSeconds
+// (Seconds is the time to solution for that K, including the step that added its new capital)
+void SweepK(assignkernel assignKernel)
+{
+    for (int k = 0; k < SWEEP_FIRST; k++) {
+        int cityIndex = SeedUniformIndex(k, SWEEP_FIRST);
+        Capitals[k].longitude = CityLongitude[cityIndex];
+        Capitals[k].latitude = CityLatitude[cityIndex];
+    }
+
+    double growSeconds = 0.;
+    for (int numCapitals = SWEEP_FIRST; numCapitals <= NUMCAPITALS; numCapitals++) {
+        double time0 = omp_get_wtime();
+        int iterations = SweepSolve(numCapitals, assignKernel);
+        double time1 = omp_get_wtime();
+
+        // (the inertia pass also adds the next K's capital)
+        double inertia = SweepInertiaAndGrow(numCapitals);
+        double time2 = omp_get_wtime();
+        for (int k = 0; k < numCapitals; k++) {
+            CapitalLongitude[k] = Capitals[k].longitude;
+            CapitalLatitude[k] = Capitals[k].latitude;
+        }
+        double silhouette = SweepSilhouette(numCapitals);
+        double time3 = omp_get_wtime();
+
+        double seconds = growSeconds + (time1 - time0);
+        double megaCityCapitalsPerSecond = (double)NumCities * (double)numCapitals * (double)iterations / (time1 - time0) / 1000000.;
+        fprintf(stderr, "%2d , %4d , %4d , %8.3lf , %3d , %10.6lf , %14.4lf , %7.4lf , %10.6lf\n",
+            NUMT, NumCities, numCapitals, megaCityCapitalsPerSecond, iterations, seconds, inertia, silhouette, time3 - time2);
+        growSeconds = time2 - time1;
+    }
+}
+
+#endif // SWEEP_H